@@ -2,9 +2,23 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+
+// A macOS shortcut converted from an fcitx key. sym is the Unicode scalar of
+// the key equivalent, or 0 if it can't be represented by one.
+struct OsxShortcut {
+    uint32_t sym;
+    uint16_t functionKey;
+    uint32_t modifiers;
+    uint16_t keycode;
+};
 
 std::string osx_key_to_fcitx_string(uint32_t unicode, uint32_t modifiers,
                                     uint16_t code) noexcept;
 std::string fcitx_string_to_osx_keysym(const char *) noexcept;
 uint32_t fcitx_string_to_osx_modifiers(const char *) noexcept;
 uint16_t fcitx_string_to_osx_keycode(const char *) noexcept;
+
+// Convert all keys of a whitespace-separated KeyList string at once. The i-th
+// element corresponds to the i-th key, including invalid ones.
+std::vector<OsxShortcut> fcitx_keylist_to_osx_shortcuts(const char *) noexcept;
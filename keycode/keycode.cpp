@@ -1,11 +1,19 @@
 #include "keycode.h"
+#include <algorithm>
+#include <array>
 #include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <fcitx-utils/stringutils.h>
+#include <fcitx-utils/utf8.h>
 #include "../deps/input-event-codes.h"
 
-static struct {
+struct SymMapping {
     uint16_t osxKeycode;
     fcitx::KeySym sym;
-} sym_mappings[] = {
+};
+
+static constexpr SymMapping sym_mappings[] = {
     // modifiers
     {kVK_Control, FcitxKey_Control_L},
     {kVK_RightControl, FcitxKey_Control_R},
@@ -75,7 +83,7 @@ static struct {
     {kVK_F12, FcitxKey_F12},
 };
 
-static struct {
+static constexpr struct {
     uint16_t osxKeycode;
     uint16_t linuxKeycode;
 } code_mappings[] = {
@@ -203,7 +211,7 @@ static struct {
     {kVK_RightShift, KEY_RIGHTSHIFT},
 };
 
-static struct {
+static constexpr struct {
     uint16_t osxKeycode;
     char asciiChar;
     char shiftedAsciiChar;
@@ -262,10 +270,12 @@ static struct {
     {kVK_ANSI_Slash, '/', '?'},
 };
 
-static struct {
+struct FunctionKeyMapping {
     fcitx::KeySym sym;
     uint16_t osxFunctionKey;
-} function_key_mappings[] = {
+};
+
+static constexpr FunctionKeyMapping function_key_mappings[] = {
     {FcitxKey_Up, NSUpArrowFunctionKey},
     {FcitxKey_Down, NSDownArrowFunctionKey},
     {FcitxKey_Left, NSLeftArrowFunctionKey},
@@ -288,7 +298,7 @@ static struct {
     {FcitxKey_Page_Down, NSPageDownFunctionKey},
 };
 
-static struct {
+static constexpr struct {
     uint32_t osxModifier;
     fcitx::KeyState fcitxModifier;
 } modifier_mappings[] = {
@@ -299,6 +309,106 @@ static struct {
     {NSEventModifierFlagCommand, fcitx::KeyState::Super},
 };
 
+// Reverse indexes for the fcitx -> macOS direction, generated at compile time
+// from the tables above so that both directions always agree.
+
+template <typename T, size_t N>
+static constexpr std::array<T, N> sortedBySym(const T (&mappings)[N]) {
+    std::array<T, N> ret{};
+    std::copy(std::begin(mappings), std::end(mappings), ret.begin());
+    std::ranges::sort(ret, {}, &T::sym);
+    return ret;
+}
+
+template <typename T, size_t N>
+static constexpr bool hasUniqueSyms(const std::array<T, N> &sorted) {
+    return std::ranges::adjacent_find(sorted, {}, &T::sym) == sorted.end();
+}
+
+static constexpr auto sym_to_osx_keycode = sortedBySym(sym_mappings);
+static_assert(hasUniqueSyms(sym_to_osx_keycode),
+              "a keysym must map to only one macOS keycode");
+
+static constexpr auto sym_to_osx_function_key =
+    sortedBySym(function_key_mappings);
+static_assert(hasUniqueSyms(sym_to_osx_function_key),
+              "a keysym must map to only one macOS function key");
+
+template <typename T, size_t N>
+static const T *findBySym(const std::array<T, N> &sorted, fcitx::KeySym sym) {
+    auto it = std::ranges::lower_bound(sorted, sym, {}, &T::sym);
+    if (it != sorted.end() && it->sym == sym) {
+        return &*it;
+    }
+    return nullptr;
+}
+
+// All mapped fcitx modifiers live in the low byte of KeyStates, so the
+// conversion of any combination is a single lookup.
+constexpr uint32_t fcitx_modifier_mask = 0xff;
+
+static constexpr auto keystates_to_osx_modifiers = [] {
+    std::array<uint32_t, fcitx_modifier_mask + 1> ret{};
+    for (uint32_t states = 0; states <= fcitx_modifier_mask; ++states) {
+        for (const auto &pair : modifier_mappings) {
+            if (states & static_cast<uint32_t>(pair.fcitxModifier)) {
+                ret[states] |= pair.osxModifier;
+            }
+        }
+    }
+    return ret;
+}();
+
+static_assert(std::ranges::all_of(modifier_mappings, [](const auto &pair) {
+    return (static_cast<uint32_t>(pair.fcitxModifier) &
+            ~fcitx_modifier_mask) == 0;
+}));
+
+// Ranges that macOS layouts actually emit, sorted. Looking them up in a dense
+// table saves the generic search in Key::keySymFromUnicode for every printable
+// keystroke.
+static constexpr struct {
+    uint32_t begin;
+    uint32_t end;
+} dense_unicode_ranges[] = {
+    {0x0000, 0x0100}, // ASCII and Latin-1
+    {0x2000, 0x2070}, // General Punctuation
+    {0x3000, 0x3040}, // CJK Symbols and Punctuation
+    {0xFF00, 0xFF70}, // Fullwidth ASCII variants and halfwidth CJK punctuation
+};
+
+static constexpr size_t dense_unicode_size = [] {
+    size_t size = 0;
+    for (const auto &range : dense_unicode_ranges) {
+        size += range.end - range.begin;
+    }
+    return size;
+}();
+
+fcitx::KeySym unicode_to_fcitx_keysym(uint32_t unicode) {
+    static const auto table = [] {
+        std::array<fcitx::KeySym, dense_unicode_size> ret{};
+        size_t i = 0;
+        for (const auto &range : dense_unicode_ranges) {
+            for (auto c = range.begin; c < range.end; ++c) {
+                ret[i++] = fcitx::Key::keySymFromUnicode(c);
+            }
+        }
+        return ret;
+    }();
+    size_t offset = 0;
+    for (const auto &range : dense_unicode_ranges) {
+        if (unicode < range.begin) {
+            break;
+        }
+        if (unicode < range.end) {
+            return table[offset + unicode - range.begin];
+        }
+        offset += range.end - range.begin;
+    }
+    return fcitx::Key::keySymFromUnicode(unicode);
+}
+
 fcitx::KeySym osx_unicode_to_fcitx_keysym(uint32_t unicode,
                                           uint32_t osxModifiers,
                                           uint16_t osxKeycode) {
@@ -330,7 +440,7 @@ fcitx::KeySym osx_unicode_to_fcitx_keysym(uint32_t unicode,
              (osxModifiers & NSEventModifierFlagShift)) {
         unicode = unicode - 'a' + 'A';
     }
-    return fcitx::Key::keySymFromUnicode(unicode);
+    return unicode_to_fcitx_keysym(unicode);
 }
 
 uint16_t osx_keycode_to_fcitx_keycode(uint16_t osxKeycode) {
@@ -343,10 +453,8 @@ uint16_t osx_keycode_to_fcitx_keycode(uint16_t osxKeycode) {
 }
 
 uint16_t fcitx_keysym_to_osx_keycode(fcitx::KeySym sym) {
-    for (const auto &pair : sym_mappings) {
-        if (pair.sym == sym) {
-            return pair.osxKeycode;
-        }
+    if (const auto *pair = findBySym(sym_to_osx_keycode, sym)) {
+        return pair->osxKeycode;
     }
     return 0;
 }
@@ -361,53 +469,81 @@ fcitx::KeyStates osx_modifiers_to_fcitx_keystates(unsigned int osxModifiers) {
     return ret;
 }
 
-std::string fcitx_keysym_to_osx_keysym(fcitx::KeySym keySym) {
+uint32_t fcitx_keysym_to_osx_unicode(fcitx::KeySym keySym) {
     // No way to distinguish with normal number keys for shortcut in menu.
     if (fcitx::Key{keySym}.isKeyPad()) {
-        return "";
+        return 0;
     }
     // keySymToString returns grave for `, which will be used as G by macOS.
-    auto sym = fcitx::Key::keySymToUTF8(keySym);
+    auto unicode = fcitx::Key::keySymToUnicode(keySym);
     // Normalized fcitx key like Control+D will show and be counted as
     // Control+Shift+D in macOS menu, so we lower it.
-    if (sym.size() == 1 && std::isupper(sym[0])) {
-        sym[0] = std::tolower(sym[0]);
+    if (unicode >= 'A' && unicode <= 'Z') {
+        unicode = unicode - 'A' + 'a';
     }
-    return sym;
+    return unicode;
+}
+
+std::string fcitx_keysym_to_osx_keysym(fcitx::KeySym keySym) {
+    return fcitx::utf8::UCS4ToUTF8(fcitx_keysym_to_osx_unicode(keySym));
 }
 
 uint16_t fcitx_keysym_to_osx_function_key(fcitx::KeySym keySym) {
-    for (const auto &pair : function_key_mappings) {
-        if (pair.sym == keySym) {
-            return pair.osxFunctionKey;
-        }
+    if (const auto *pair = findBySym(sym_to_osx_function_key, keySym)) {
+        return pair->osxFunctionKey;
     }
     return 0;
 }
 
 uint32_t fcitx_keystates_to_osx_modifiers(fcitx::KeyStates ks) {
-    uint32_t ret{};
-    for (const auto &pair : modifier_mappings) {
-        if (ks & pair.fcitxModifier) {
-            ret |= pair.osxModifier;
-        }
+    return keystates_to_osx_modifiers[ks.toInteger() & fcitx_modifier_mask];
+}
+
+// Swift views convert the same few shortcuts every time they are rendered, so
+// keep the parsed result instead of parsing the string again.
+static std::mutex parsed_keys_mutex;
+static std::unordered_map<std::string, fcitx::Key> parsed_keys;
+constexpr size_t parsed_keys_capacity = 256;
+
+static fcitx::Key parse_fcitx_key(std::string_view s) {
+    std::lock_guard lock(parsed_keys_mutex);
+    std::string str{s};
+    if (auto it = parsed_keys.find(str); it != parsed_keys.end()) {
+        return it->second;
     }
-    return ret;
+    if (parsed_keys.size() >= parsed_keys_capacity) {
+        parsed_keys.clear();
+    }
+    fcitx::Key key{str};
+    parsed_keys.emplace(std::move(str), key);
+    return key;
 }
 
 std::string fcitx_string_to_osx_keysym(const char *s) noexcept {
-    fcitx::Key key{s};
-    return fcitx_keysym_to_osx_keysym(key.sym());
+    return fcitx_keysym_to_osx_keysym(parse_fcitx_key(s).sym());
 }
 
 uint32_t fcitx_string_to_osx_modifiers(const char *s) noexcept {
-    fcitx::Key key{s};
-    return fcitx_keystates_to_osx_modifiers(key.states());
+    return fcitx_keystates_to_osx_modifiers(parse_fcitx_key(s).states());
 }
 
 uint16_t fcitx_string_to_osx_keycode(const char *s) noexcept {
-    fcitx::Key key{s};
-    return fcitx_keysym_to_osx_keycode(key.sym());
+    return fcitx_keysym_to_osx_keycode(parse_fcitx_key(s).sym());
+}
+
+std::vector<OsxShortcut>
+fcitx_keylist_to_osx_shortcuts(const char *keyList) noexcept {
+    std::vector<OsxShortcut> ret;
+    // Don't use Key::keyListFromString, which drops invalid keys and thus
+    // breaks the correspondence between input and output.
+    for (const auto &s : fcitx::stringutils::split(keyList, FCITX_WHITESPACE)) {
+        auto key = parse_fcitx_key(s);
+        ret.push_back({fcitx_keysym_to_osx_unicode(key.sym()),
+                       fcitx_keysym_to_osx_function_key(key.sym()),
+                       fcitx_keystates_to_osx_modifiers(key.states()),
+                       fcitx_keysym_to_osx_keycode(key.sym())});
+    }
+    return ret;
 }
 
 fcitx::Key osx_key_to_fcitx_key(uint32_t unicode, uint32_t modifiers,
@@ -41,6 +41,8 @@ enum {
 };
 // clang-format on
 
+// Same as fcitx::Key::keySymFromUnicode but faster for common characters.
+fcitx::KeySym unicode_to_fcitx_keysym(uint32_t unicode);
 fcitx::KeySym osx_unicode_to_fcitx_keysym(uint32_t unicode,
                                           uint32_t osxModifiers,
                                           uint16_t osxKeycode);
@@ -53,6 +55,7 @@ fcitx::Key osx_key_to_fcitx_key(uint32_t unicode, uint32_t modifiers,
 // Used for showing shortcut configuration and setting shortcut for menu items.
 // No need to be complete and sometimes must be inaccurate (e.g. A -> a).
 std::string fcitx_keysym_to_osx_keysym(fcitx::KeySym);
+uint32_t fcitx_keysym_to_osx_unicode(fcitx::KeySym);
 uint16_t fcitx_keysym_to_osx_function_key(fcitx::KeySym);
 
 uint16_t fcitx_keysym_to_osx_keycode(fcitx::KeySym);
@@ -0,0 +1,94 @@
+#include <algorithm>
+#include <bit>
+#include <fcitx-utils/log.h>
+
+#include "latency.h"
+
+namespace fcitx {
+
+static size_t bucketOf(uint64_t us) {
+    return std::min<size_t>(std::bit_width(us), LatencyHistogram::Buckets - 1);
+}
+
+void LatencyHistogram::add(uint64_t us) {
+    if (size_ == Window) {
+        --counts_[bucketOf(samples_[next_])];
+    } else {
+        ++size_;
+    }
+    samples_[next_] = us;
+    ++counts_[bucketOf(us)];
+    next_ = (next_ + 1) % Window;
+}
+
+void LatencyHistogram::clear() {
+    counts_.fill(0);
+    next_ = size_ = 0;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (size_ == 0) {
+        return 0;
+    }
+    // Samples are in [0, size_) until window is full.
+    std::array<uint64_t, Window> sorted = samples_;
+    auto end = sorted.begin() + size_;
+    auto nth = sorted.begin() + std::clamp<size_t>(p * size_, 0, size_ - 1);
+    std::nth_element(sorted.begin(), nth, end);
+    return *nth;
+}
+
+nlohmann::json LatencyHistogram::toJson() const {
+    auto buckets = nlohmann::json::array();
+    for (size_t i = 0; i < Buckets; ++i) {
+        if (counts_[i]) {
+            // [upper bound in us, count]
+            buckets.push_back({uint64_t(1) << i, counts_[i]});
+        }
+    }
+    return {{"count", size_},
+            {"p50", percentile(0.5)},
+            {"p90", percentile(0.9)},
+            {"max", percentile(1)},
+            {"buckets", buckets}};
+}
+
+bool AppLatency::record(const std::string &app, uint64_t us) {
+    std::lock_guard lock(mutex_);
+    auto &entry = apps_[app];
+    entry.histogram.add(us);
+    if (entry.histogram.size() < MinSamples) {
+        return entry.fallback;
+    }
+    uint64_t budget = budget_;
+    auto median = entry.histogram.percentile(0.5);
+    if (!entry.fallback && median > budget) {
+        entry.fallback = true;
+        FCITX_INFO() << operation_ << " of " << app << " takes " << median
+                     << "us (budget " << budget << "us), fall back to "
+                     << fallback_;
+    } else if (entry.fallback && median < budget / 2) {
+        entry.fallback = false;
+        FCITX_INFO() << operation_ << " of " << app << " recovers to "
+                     << median << "us";
+    }
+    return entry.fallback;
+}
+
+bool AppLatency::fallback(const std::string &app) const {
+    std::lock_guard lock(mutex_);
+    auto it = apps_.find(app);
+    return it != apps_.end() && it->second.fallback;
+}
+
+nlohmann::json AppLatency::toJson() const {
+    std::lock_guard lock(mutex_);
+    auto j = nlohmann::json::object();
+    for (const auto &[app, entry] : apps_) {
+        j[app] = entry.histogram.toJson();
+        j[app]["fallback"] = entry.fallback;
+    }
+    return j;
+}
+
+} // namespace fcitx
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <nlohmann/json.hpp>
+
+namespace fcitx {
+
+/// Latencies of the most recent samples in microseconds. Buckets are powers
+/// of 2, i.e. bucket i counts samples in [2^(i-1), 2^i), and the last one
+/// also counts larger samples.
+class LatencyHistogram {
+public:
+    static constexpr size_t Window = 64;
+    static constexpr size_t Buckets = 24;
+
+    void add(uint64_t us);
+    void clear();
+    size_t size() const { return size_; }
+    // Exact percentile of samples in window, p in [0, 1].
+    uint64_t percentile(double p) const;
+    nlohmann::json toJson() const;
+
+private:
+    std::array<uint64_t, Window> samples_{};
+    std::array<uint32_t, Buckets> counts_{};
+    size_t next_ = 0;
+    size_t size_ = 0;
+};
+
+/// Latency of an operation per app. An app whose median latency exceeds the
+/// budget is put into fallback, so that caller switches to a cheaper strategy
+/// for it, and it recovers when the median drops below half of the budget.
+/// Thread safe.
+class AppLatency {
+public:
+    // Minimal samples before an app is judged.
+    static constexpr size_t MinSamples = 8;
+
+    AppLatency(std::string operation, std::string fallback, uint64_t budget)
+        : operation_(std::move(operation)), fallback_(std::move(fallback)),
+          budget_(budget) {}
+
+    void setBudget(uint64_t us) { budget_ = us; }
+    // Returns whether app is in fallback, taking the sample into account.
+    bool record(const std::string &app, uint64_t us);
+    bool fallback(const std::string &app) const;
+    nlohmann::json toJson() const;
+
+private:
+    struct App {
+        LatencyHistogram histogram;
+        bool fallback = false;
+    };
+    // For logs, e.g. "Caret query" and "query once per composition".
+    const std::string operation_;
+    const std::string fallback_;
+    std::atomic<uint64_t> budget_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, App> apps_;
+};
+
+} // namespace fcitx
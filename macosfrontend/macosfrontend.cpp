@@ -10,6 +10,7 @@
 #include "keycode.h"
 #include "macosfrontend-swift.h"
 
+#include <chrono>
 #include <CoreFoundation/CoreFoundation.h>
 #include <fcitx-utils/event.h>
 #include <fcitx/addonmanager.h>
@@ -122,6 +123,7 @@ void MacosFrontend::updateConfig() {
     simulateKeyRelease_ = config_.simulateKeyRelease.value();
     simulateKeyReleaseDelay_ =
         static_cast<long>(config_.simulateKeyReleaseDelay.value()) * 1000L;
+    caretLatency_.setBudget(*config_.caretQueryBudget * 1000);
     pollPasteboard();
 }
 
@@ -268,6 +270,8 @@ void MacosFrontend::focusIn(ICUUID uuid, bool isPassword) {
         return;
     webpanel_->applyAppAccentColor(ic->getAccentColor()); // app-specific
     ic->setPassword(isPassword);
+    // Window of the client may have moved since last focus.
+    ic->caretCache()->reset();
     ic->focusIn();
     auto program = ic->program();
     FCITX_INFO() << "Focus in " << program;
@@ -315,6 +319,8 @@ MacosInputContext::MacosInputContext(MacosFrontend *frontend,
                                      const std::string &accentColor)
     : InputContext(inputContextManager, program), frontend_(frontend),
       accentColor_(accentColor) {
+    caretCache_->program = program;
+    caretCache_->latency = &frontend->caretLatency();
     created();
 }
 
@@ -322,6 +328,7 @@ MacosInputContext::~MacosInputContext() { destroy(); }
 
 void MacosInputContext::commitStringImpl(const std::string &text) {
     state_.commit += text;
+    caretCache_->reset();
     // For async event we need to perform commit, otherwise it's buffered and
     // committed in next commit with a key event. e.g. fcitx commits a ，
     // asynchronously when deleting , after a number/English character.
@@ -334,9 +341,17 @@ void MacosInputContext::commitStringImpl(const std::string &text) {
 }
 
 void MacosInputContext::updatePreeditImpl() {
-    auto preedit =
-        frontend_->instance()->outputFilter(this, inputPanel().clientPreedit());
-    state_.preedit = preedit.toString();
+    auto preedit = webpanel_->outputFilter(this, inputPanel().clientPreedit());
+    auto text = preedit.toString();
+    // A longer or shorter preedit may wrap or scroll the line, and FollowCaret
+    // anchors at caret. Other changes like highlight keep the rectangle.
+    if (text.empty() != state_.preedit.empty()) {
+        caretCache_->reset();
+    } else if (text.size() != state_.preedit.size() ||
+               preedit.cursor() != state_.caretPos) {
+        caretCache_->invalidate();
+    }
+    state_.preedit = std::move(text);
     state_.caretPos = preedit.cursor();
 }
 
@@ -351,22 +366,55 @@ std::string MacosInputContext::popState(bool accepted) {
     return j.dump();
 }
 
-void MacosInputContext::commitAndSetPreeditAsync() {
+InputContextState MacosInputContext::takeAsyncState() {
     auto state = state_;
     resetState();
-    SwiftFrontend::commitAndSetPreeditAsync(state.commit, state.preedit,
-                                            state.caretPos, state.dummyPreedit);
+    return state;
+}
+
+void MacosInputContext::commitAndSetPreedit(const InputContextState &state) {
+    SwiftFrontend::commitAndSetPreedit(state.commit, state.preedit,
+                                       state.caretPos, state.dummyPreedit);
 }
 
 std::tuple<double, double, double>
-MacosInputContext::getCaretCoordinates(bool followCaret) {
+MacosInputContext::getCaretCoordinates(bool followCaret, CaretCache *cache,
+                                       CaretCache::Version version) {
     // Memorize to avoid jumping to origin on failure.
     static double x = 0, y = 0, height = 0;
+    if (cache && cache->valid && cache->followCaret == followCaret) {
+        auto current = cache->version();
+        bool hit =
+            cache->fallback
+                ? cache->validVersion.composition == version.composition &&
+                      current.composition == version.composition
+                : cache->validVersion.generation == version.generation &&
+                      current.generation == version.generation;
+        if (hit) {
+            ++CaretCache::hits;
+            return cache->rect;
+        }
+    }
+    ++CaretCache::misses;
+    auto start = std::chrono::steady_clock::now();
     auto res = SwiftFrontend::getCaretCoordinates(followCaret);
+    if (cache && cache->latency) {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+        cache->fallback = cache->latency->record(cache->program, us);
+    }
     if (res.getCount() == 3) {
         x = res[0];
         y = res[1];
         height = res[2];
+        // Failures are not cached so that next show retries.
+        if (cache) {
+            cache->valid = true;
+            cache->validVersion = version;
+            cache->followCaret = followCaret;
+            cache->rect = std::make_tuple(x, y, height);
+        }
     } else {
         FCITX_DEBUG() << "Failed to get caret coordinates";
     }
@@ -388,11 +436,20 @@ FCITX_ADDON_FACTORY_V2(macosfrontend, fcitx::MacosFrontendFactory);
 std::string process_key(ICUUID uuid, uint32_t unicode, uint32_t osxModifiers,
                         uint16_t osxKeycode, bool isRelease,
                         bool isPassword) noexcept {
+    auto received = std::chrono::steady_clock::now();
     const fcitx::Key parsedKey =
         osx_key_to_fcitx_key(unicode, osxModifiers, osxKeycode);
     return with_fcitx([=](Fcitx &fcitx) {
         auto that = dynamic_cast<fcitx::MacosFrontend *>(fcitx.frontend());
-        return that->keyEvent(uuid, parsedKey, isRelease, isPassword);
+        // Waiting for fcitx thread counts as engine time.
+        if (webpanel_ && !isRelease) {
+            webpanel_->keyReceived(received);
+        }
+        auto state = that->keyEvent(uuid, parsedKey, isRelease, isPassword);
+        if (webpanel_ && !isRelease) {
+            webpanel_->keyProcessed();
+        }
+        return state;
     });
 }
 
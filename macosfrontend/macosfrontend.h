@@ -8,6 +8,9 @@
 #ifndef _FCITX5_MACOS_MACOSFRONTEND_H_
 #define _FCITX5_MACOS_MACOSFRONTEND_H_
 
+#include <atomic>
+#include <memory>
+#include <tuple>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/iniparser.h>
 #include <fcitx-utils/event.h>
@@ -18,6 +21,7 @@
 #include <fcitx/focusgroup.h>
 #include <fcitx/instance.h>
 
+#include "latency.h"
 #include "macosfrontend-public.h"
 
 #define TERMINAL_USE_EN                                                        \
@@ -69,7 +73,11 @@ FCITX_CONFIGURATION(
                                           true};
     Option<int, IntConstrain> pollPasteboardInterval{
         this, "PollPasteboardInterval", _("Poll Pasteboard interval (s)"), 2,
-        IntConstrain(1, 60)};);
+        IntConstrain(1, 60)};
+    Option<int, IntConstrain> caretQueryBudget{
+        this, "CaretQueryBudget",
+        _("Budget of querying caret position in milliseconds"), 20,
+        IntConstrain(1, 1000)};);
 
 class MacosFrontend : public AddonInstance {
 public:
@@ -95,6 +103,7 @@ public:
     void focusIn(ICUUID, bool isPassword);
     std::string commitComposition(ICUUID uuid);
     void focusOut(ICUUID);
+    AppLatency &caretLatency() { return caretLatency_; }
 
 private:
     Instance *instance_;
@@ -104,6 +113,8 @@ private:
     long simulateKeyReleaseDelay_;
     std::unique_ptr<EventSourceTime> monitorPasteboardEvent_;
     void pollPasteboard();
+    AppLatency caretLatency_{"Caret query", "querying once per composition",
+                             20000};
 
     static const inline std::string ConfPath = "conf/macosfrontend.conf";
 
@@ -126,6 +137,40 @@ struct InputContextState {
     bool vimPreedit;
 };
 
+/// Caret rectangle of an IC. Querying it is a synchronous IPC to the client
+/// app, so it's reused until commit, preedit or focus changes invalidate it.
+/// For apps whose query exceeds budget, it's only invalidated by commit and
+/// focus, i.e. queried once per composition.
+/// Invalidated in fcitx thread, and read and filled in main thread.
+struct CaretCache {
+    struct Version {
+        uint64_t generation = 0;
+        uint64_t composition = 0;
+    };
+    // Preedit or caret changes.
+    void invalidate() { ++generation; }
+    // A new composition starts after commit, focus or clearing preedit.
+    void reset() {
+        ++composition;
+        ++generation;
+    }
+    Version version() const { return {generation, composition}; }
+
+    std::atomic<uint64_t> generation = 0;
+    std::atomic<uint64_t> composition = 0;
+    // Set on creation.
+    std::string program;
+    AppLatency *latency = nullptr;
+    // Below are only accessed in main thread.
+    bool valid = false;
+    Version validVersion;
+    bool followCaret = false;
+    bool fallback = false;
+    std::tuple<double, double, double> rect;
+    static inline std::atomic<uint64_t> hits = 0;
+    static inline std::atomic<uint64_t> misses = 0;
+};
+
 class MacosInputContext : public InputContext {
 public:
     MacosInputContext(MacosFrontend *frontend,
@@ -140,8 +185,14 @@ public:
     void forwardKeyImpl(const ForwardKeyEvent &key) override {}
     void updatePreeditImpl() override;
 
+    // version is read from cache when show is requested, so that a stale
+    // request doesn't fill cache for the current composition.
     static std::tuple<double, double, double>
-    getCaretCoordinates(bool followCaret);
+    getCaretCoordinates(bool followCaret, CaretCache *cache = nullptr,
+                        CaretCache::Version version = {});
+    const std::shared_ptr<CaretCache> &caretCache() const {
+        return caretCache_;
+    }
     std::string getAccentColor() { return accentColor_; }
 
     void resetState() {
@@ -158,7 +209,10 @@ public:
     // preedit need to be set in batch synchronously before returning. Otherwise
     // set them in batch asynchronously.
     bool isSyncEvent = false;
-    void commitAndSetPreeditAsync();
+    // Take commit and preedit of an async event, which are set in main thread
+    // by commitAndSetPreedit, before the panel frame is shown.
+    InputContextState takeAsyncState();
+    static void commitAndSetPreedit(const InputContextState &state);
 
     void setPassword(bool isPassword);
     void setVimMode(bool vimMode) { vimMode_ = vimMode; }
@@ -167,6 +221,8 @@ public:
 private:
     MacosFrontend *frontend_;
     InputContextState state_;
+    // Shared with pending main thread blocks that may outlive this IC.
+    std::shared_ptr<CaretCache> caretCache_ = std::make_shared<CaretCache>();
     std::string accentColor_;
     bool vimMode_ = false;
 };
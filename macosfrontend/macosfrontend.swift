@@ -134,15 +134,15 @@ public func commitAndSetPreeditSync(
   }
 }
 
-public func commitAndSetPreeditAsync(
+// Called from C++ within dispatch_async(dispatch_get_main_queue()), before
+// candidate window of the same frame is shown at caret.
+public func commitAndSetPreedit(
   _ commit: String, _ preedit: String, _ caretPos: Int, _ dummyPreedit: Bool
 ) {
-  Task { @MainActor in
-    guard let client = client else {
-      return
-    }
-    commitAndSetPreeditSync(client, commit, preedit, caretPos, dummyPreedit)
+  guard let client = client else {
+    return
   }
+  commitAndSetPreeditSync(client, commit, preedit, caretPos, dummyPreedit)
 }
 
 public func commitAsync(_ commit: String) {
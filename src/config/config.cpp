@@ -113,6 +113,8 @@ bool setConfig(const char *uri_, const char *json_) {
                 } else {
                     addon->setSubConfig(subPath, config);
                 }
+                // The addon may be an output filter.
+                webpanel_->clearFilterCache();
                 return true;
             } else {
                 FCITX_ERROR() << "Failed to get addon";
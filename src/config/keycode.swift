@@ -16,12 +16,35 @@ func macKeyToFcitxString(_ key: String, _ modifiers: NSEvent.ModifierFlags, _ co
   return String(osx_key_to_fcitx_string(unicode, UInt32(modifiers.rawValue), code))
 }
 
-func fcitxStringToMacShortcut(_ s: String) -> (String, String?) {
-  let key = String(fcitx_string_to_osx_keysym(s))
-  let modifiers = NSEvent.ModifierFlags(rawValue: UInt(fcitx_string_to_osx_modifiers(s)))
-  let code = fcitx_string_to_osx_keycode(s)
-  if key.isEmpty && code == 0 {
-    return (s, nil)
+private func osxShortcutToMacShortcut(_ shortcut: OsxShortcut) -> (String, String?)? {
+  if shortcut.sym == 0 && shortcut.keycode == 0 {
+    return nil
+  }
+  let key = Unicode.Scalar(shortcut.sym).map { String($0) } ?? ""
+  let modifiers = NSEvent.ModifierFlags(rawValue: UInt(shortcut.modifiers))
+  return shortcutRepr(key, modifiers, shortcut.keycode)
+}
+
+// Converts all keys in one call. An empty or unmappable key is nil and
+// doesn't affect the other keys.
+func fcitxKeyListToMacShortcuts(_ keys: [String]) -> [(String, String?)?] {
+  var result = [(String, String?)?](repeating: nil, count: keys.count)
+  // Keys are joined by space, so those containing whitespace, which are never
+  // valid, would break the correspondence.
+  let indices = keys.indices.filter {
+    !keys[$0].isEmpty && keys[$0].rangeOfCharacter(from: .whitespacesAndNewlines) == nil
+  }
+  let shortcuts = Array(
+    fcitx_keylist_to_osx_shortcuts(indices.map { keys[$0] }.joined(separator: " ")))
+  if shortcuts.count != indices.count {
+    return result
   }
-  return shortcutRepr(key, modifiers, code)
+  for (index, shortcut) in zip(indices, shortcuts) {
+    result[index] = osxShortcutToMacShortcut(shortcut)
+  }
+  return result
+}
+
+func fcitxStringToMacShortcut(_ s: String) -> (String, String?) {
+  return fcitxKeyListToMacShortcuts([s])[0] ?? (s, nil)
 }
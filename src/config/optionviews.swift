@@ -29,6 +29,8 @@ func recordedKeyView(_ pair: (String, String?)) -> some View {
 struct KeyOptionView: OptionView {
   let label: String
   @ObservedObject var model: KeyOption
+  // Converted by the containing list in one batch, keyed by key string.
+  var shortcuts: [String: (String, String?)] = [:]
   @State private var showRecorder = false
   @State private var recordedShortcut: (String, String?) = ("", nil)
   @State private var recordedKey = ""
@@ -39,7 +41,9 @@ struct KeyOptionView: OptionView {
     Button {
       showRecorder = true
     } label: {
-      recordedKeyView(model.value.isEmpty ? ("●REC", nil) : fcitxStringToMacShortcut(model.value))
+      recordedKeyView(
+        model.value.isEmpty
+          ? ("●REC", nil) : shortcuts[model.value] ?? fcitxStringToMacShortcut(model.value))
         .frame(
           minWidth: 100)
     }.sheet(isPresented: $showRecorder) {
@@ -289,11 +293,16 @@ struct ListOptionView<T: Option & EmptyConstructible>: OptionView {
   @ObservedObject var model: ListOption<T>
 
   var body: some View {
+    let shortcuts = keyShortcuts()
     VStack {
       ForEach(model.value) { element in
         HStack {
           Spacer()
-          AnyView(buildViewImpl(label: "", option: element.value))
+          if let option = element.value as? KeyOption {
+            KeyOptionView(label: "", model: option, shortcuts: shortcuts)
+          } else {
+            AnyView(buildViewImpl(label: "", option: element.value))
+          }
 
           let index = findElementIndex(element)
           Button {
@@ -343,6 +352,20 @@ struct ListOptionView<T: Option & EmptyConstructible>: OptionView {
     )
   }
 
+  private func keyShortcuts() -> [String: (String, String?)] {
+    let keys = model.value.compactMap { ($0.value as? KeyOption)?.value }
+    if keys.isEmpty {
+      return [:]
+    }
+    var shortcuts = [String: (String, String?)]()
+    for (key, shortcut) in zip(keys, fcitxKeyListToMacShortcuts(keys)) {
+      if let shortcut = shortcut {
+        shortcuts[key] = shortcut
+      }
+    }
+    return shortcuts
+  }
+
   private func findElementIndex(_ element: Identified<T>) -> Int {
     // SAFETY: element should be inside the array.
     return model.value.firstIndex(where: { $0.id == element.id })!
@@ -527,6 +527,8 @@ void activateActionById(int id, bool hotkey) noexcept {
                 auto keyEvent = fcitx::KeyEvent(ic, keyList.front(), false);
                 ic->keyEvent(keyEvent);
             } else {
+                // e.g. toggling chttrans updates preedit immediately.
+                webpanel_->invalidateFilterState();
                 action->activate(ic);
             }
         }
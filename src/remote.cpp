@@ -23,6 +23,16 @@ std::pair<bool, std::string> remoteHandler(const std::string_view command,
         if (command == "n") {
             return {true, imGetCurrentIMName() + "\n"};
         }
+        if (command == "m") {
+            json j = json::object();
+            if (webpanel_) {
+                j["webpanel"] = webpanel_->metrics();
+            }
+            if (auto frontend = fcitx.frontend()) {
+                j["caretLatency"] = frontend->caretLatency().toJson();
+            }
+            return {true, j.dump() + "\n"};
+        }
         if (command == "s") {
             try {
                 auto j = json::parse(body);
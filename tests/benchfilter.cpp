@@ -0,0 +1,140 @@
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include "../webpanel/filtercache.h"
+
+using namespace fcitx;
+
+static std::mt19937 rng(42);
+
+static const std::vector<std::string> simplifiedChars = {
+    "的", "是", "这", "为", "个", "国", "时", "发", "后", "们",
+    "说", "会", "头", "家", "以", "开", "关", "里", "面", "对"};
+
+// Longest match on a phrase dictionary, the way OpenCC converts.
+static const std::unordered_map<std::string, std::string> dictionary = {
+    {"这", "這"},     {"为", "為"},     {"个", "個"},     {"国", "國"},
+    {"时", "時"},     {"发", "發"},     {"后", "後"},     {"们", "們"},
+    {"说", "說"},     {"会", "會"},     {"头", "頭"},     {"开", "開"},
+    {"关", "關"},     {"里", "裡"},     {"对", "對"},     {"头发", "頭髮"},
+    {"以后", "以後"}, {"国家", "國家"}, {"里面", "裡面"}, {"面对", "面對"}};
+constexpr size_t maxPhraseLength = 4;
+
+static std::vector<std::string> splitChars(const std::string &s) {
+    std::vector<std::string> chars;
+    for (size_t i = 0; i < s.size();) {
+        auto c = static_cast<unsigned char>(s[i]);
+        size_t length = c < 0x80 ? 1 : c < 0xe0 ? 2 : c < 0xf0 ? 3 : 4;
+        chars.push_back(s.substr(i, length));
+        i += length;
+    }
+    return chars;
+}
+
+static std::string toTraditional(const std::string &s) {
+    auto chars = splitChars(s);
+    std::string result;
+    for (size_t i = 0; i < chars.size();) {
+        size_t length = std::min(maxPhraseLength, chars.size() - i);
+        for (; length > 1; --length) {
+            std::string phrase;
+            for (size_t j = i; j < i + length; ++j) {
+                phrase += chars[j];
+            }
+            if (auto it = dictionary.find(phrase); it != dictionary.end()) {
+                result += it->second;
+                break;
+            }
+        }
+        if (length == 1) {
+            auto it = dictionary.find(chars[i]);
+            result += it == dictionary.end() ? chars[i] : it->second;
+        }
+        i += length;
+    }
+    return result;
+}
+
+static Text traditionalFilter(const Text &text) {
+    Text result;
+    for (size_t i = 0; i < text.size(); ++i) {
+        result.append(toTraditional(text.stringAt(i)), text.formatAt(i));
+    }
+    result.setCursor(text.cursor());
+    return result;
+}
+
+static std::string randomWord() {
+    std::string word;
+    int length = std::uniform_int_distribution(1, 4)(rng);
+    for (int i = 0; i < length; ++i) {
+        word += simplifiedChars[std::uniform_int_distribution<size_t>(
+            0, simplifiedChars.size() - 1)(rng)];
+    }
+    return word;
+}
+
+static std::vector<Text> randomTexts(int count) {
+    std::vector<Text> texts;
+    for (int i = 0; i < count; ++i) {
+        // Candidate text and comment.
+        texts.emplace_back(randomWord());
+        texts.emplace_back(std::uniform_int_distribution(0, 3)(rng) == 0
+                               ? "(" + randomWord() + ")"
+                               : "");
+    }
+    return texts;
+}
+
+// Filter texts and comments of a 200-candidate scroll view per keystroke,
+// which mostly re-renders the same candidates, e.g. when moving highlight.
+static void benchMemo() {
+    constexpr int keystrokes = 2000;
+    constexpr int count = 200;
+    FilterCache cache(2048);
+    auto state = cache.intern("");
+    auto texts = randomTexts(count);
+    std::chrono::nanoseconds direct{0};
+    std::chrono::nanoseconds memoized{0};
+    for (int i = 0; i < keystrokes; ++i) {
+        switch (std::uniform_int_distribution(0, 9)(rng)) {
+        case 0: // new input
+        case 1:
+            texts = randomTexts(count);
+            break;
+        case 2: { // new input keeping leading candidates
+            auto tail = randomTexts(count / 2);
+            std::move(tail.begin(), tail.end(), texts.begin() + count);
+            break;
+        }
+        default: // same candidates
+            break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (const auto &text : texts) {
+            traditionalFilter(text);
+        }
+        auto middle = std::chrono::steady_clock::now();
+        for (const auto &text : texts) {
+            cache.filter(state, text, traditionalFilter);
+        }
+        auto end = std::chrono::steady_clock::now();
+        direct += middle - start;
+        memoized += end - middle;
+    }
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    std::cout << "200-candidate scroll view: direct "
+              << duration_cast<microseconds>(direct).count() / keystrokes
+              << " us/key, memoized "
+              << duration_cast<microseconds>(memoized).count() / keystrokes
+              << " us/key, "
+              << cache.hits() * 100 / (cache.hits() + cache.misses())
+              << "% hits" << std::endl;
+}
+
+int main() {
+    benchMemo();
+    return 0;
+}
@@ -0,0 +1,112 @@
+#include <array>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include "../webpanel/candidateframe.h"
+
+using namespace fcitx;
+
+static std::mt19937 rng(42);
+
+static std::string randomWord() {
+    static const std::vector<std::string> chars = {
+        "的", "是", "在", "不", "了", "有", "和", "人", "这", "中",
+        "大", "为", "上", "个", "国", "我", "以", "要", "他", "时"};
+    std::string word;
+    int length = std::uniform_int_distribution(1, 4)(rng);
+    for (int i = 0; i < length; ++i) {
+        word += chars[std::uniform_int_distribution<size_t>(
+            0, chars.size() - 1)(rng)];
+    }
+    return word;
+}
+
+static std::vector<candidate_window::Candidate> randomCandidates(int count,
+                                                                 bool paged) {
+    std::vector<candidate_window::Candidate> candidates;
+    for (int i = 0; i < count; ++i) {
+        candidate_window::Candidate candidate{
+            randomWord(), paged ? std::to_string((i + 1) % 10) : "", "", {}};
+        if (std::uniform_int_distribution(0, 3)(rng) == 0) {
+            candidate.comment = "(" + randomWord() + ")";
+        }
+        candidates.push_back(std::move(candidate));
+    }
+    return candidates;
+}
+
+static size_t
+stringBytes(const std::vector<candidate_window::Candidate> &rows) {
+    size_t bytes = 0;
+    for (const auto &row : rows) {
+        bytes += row.text.size() + row.label.size() + row.comment.size();
+    }
+    return bytes;
+}
+
+// Simulate keystrokes on a panel showing count candidates and report bytes
+// of strings passed to set_candidates per keystroke, when every update is
+// sent and when unchanged frames are skipped, as WebPanel::setCandidates
+// does. Any other change still sends all candidates, as set_candidates has
+// no partial update.
+static void bench(const std::string &name, int count, bool paged) {
+    constexpr int keystrokes = 10000;
+    auto rows = randomCandidates(count, paged);
+    int highlighted = 0;
+    auto prev = std::make_shared<const CandidateFrame>(
+        CandidateFrame{rows, highlighted});
+    size_t alwaysBytes = 0;
+    size_t sentBytes = 0;
+    std::array<int, 3> changeCount{};
+    std::chrono::microseconds elapsed{0};
+    for (int i = 0; i < keystrokes; ++i) {
+        switch (std::uniform_int_distribution(0, 9)(rng)) {
+        case 0: // new input
+        case 1:
+            rows = randomCandidates(count, paged);
+            highlighted = 0;
+            break;
+        case 2: // new input keeping leading candidates, e.g. adding a letter
+            for (int j = count / 2; j < count; ++j) {
+                rows[j] = randomCandidates(1, paged)[0];
+            }
+            break;
+        case 3: // page flip
+            if (paged) {
+                rows = randomCandidates(count, paged);
+                highlighted = 0;
+                break;
+            }
+            [[fallthrough]];
+        case 4: // engine updates UI without change, e.g. for Shift
+            break;
+        default: // move highlight
+            highlighted = (highlighted + 1) % count;
+            break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        // Built from candidates of engine, as WebPanel::render does.
+        CandidateFrame next{rows, highlighted};
+        auto change = diffCandidateFrames(*prev, next);
+        if (change != FrameChange::None) {
+            prev = std::make_shared<const CandidateFrame>(std::move(next));
+            sentBytes += stringBytes(prev->candidates);
+        }
+        elapsed += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        alwaysBytes += stringBytes(rows);
+        ++changeCount[static_cast<int>(change)];
+    }
+    std::cout << name << ": always sending " << alwaysBytes / keystrokes
+              << " B/key, skipping unchanged " << sentBytes / keystrokes
+              << " B/key (none " << changeCount[0] << ", cursor only "
+              << changeCount[1] << ", changed " << changeCount[2] << "), "
+              << elapsed.count() / keystrokes << " us/key" << std::endl;
+}
+
+int main() {
+    bench("10-candidate page", 10, true);
+    bench("200-candidate scroll view", 200, false);
+    return 0;
+}
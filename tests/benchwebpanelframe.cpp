@@ -0,0 +1,146 @@
+// Drives WebPanel with RecordingCandidateWindow, and reports time and bytes
+// sent to candidate window per frame. Run
+// build/<arch>/tests/webpanel-frame-bench after building, preferably Release.
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <dispatch/dispatch.h>
+#include <fcitx/candidatelist.h>
+#include <fcitx/inputcontext.h>
+#include <fcitx/inputpanel.h>
+
+#include "fcitx.h"
+#include "recordingcandidatewindow.h"
+
+using namespace fcitx;
+using candidate_window::RecordingCandidateWindow;
+
+// Default MaxColumnCount * (MaxRowCount + 1).
+constexpr int expandCount = 42;
+constexpr int pageSize = 10;
+
+struct Frame {
+    double us;
+    size_t bytes;
+};
+
+struct Stat {
+    double us = 0;
+    size_t bytes = 0;
+    int frames = 0;
+    void add(const Frame &frame) {
+        us += frame.us;
+        bytes += frame.bytes;
+        ++frames;
+    }
+};
+
+/// A frame ends when window is shown or hidden.
+static Frame measure(RecordingCandidateWindow &window,
+                     const std::function<void()> &drive) {
+    auto from = window.size();
+    auto start = RecordingCandidateWindow::Clock::now();
+    drive();
+    auto end = window.waitFor({"show", "hide"}, from, std::chrono::seconds(5));
+    if (!end) {
+        std::cerr << "Frame not shown" << std::endl;
+        std::exit(1);
+    }
+    auto calls = window.calls(from);
+    calls.resize(*end - from + 1);
+    Frame frame{std::chrono::duration<double, std::micro>(calls.back().time -
+                                                          start)
+                    .count(),
+                0};
+    for (const auto &call : calls) {
+        frame.bytes += call.bytes;
+    }
+    return frame;
+}
+
+static void setCandidates(int count, int round, int cursor) {
+    with_fcitx([=](Fcitx &fcitx) {
+        auto *ic = fcitx.instance()->mostRecentInputContext();
+        auto list = std::make_unique<CommonCandidateList>();
+        list->setPageSize(pageSize);
+        for (int i = 0; i < count; ++i) {
+            list->append<DisplayOnlyCandidateWord>(Text(
+                "候选" + std::to_string(round) + "-" + std::to_string(i)));
+        }
+        list->setGlobalCursorIndex(cursor);
+        ic->inputPanel().setPreedit(Text("hou xuan " + std::to_string(round)));
+        ic->inputPanel().setCandidateList(std::move(list));
+        ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    });
+}
+
+static void moveCursor(int cursor) {
+    with_fcitx([=](Fcitx &fcitx) {
+        auto *ic = fcitx.instance()->mostRecentInputContext();
+        auto *list = static_cast<CommonCandidateList *>(
+            ic->inputPanel().candidateList().get());
+        list->setGlobalCursorIndex(cursor);
+        ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+    });
+}
+
+static void report(const char *name, int count, const Stat &stat) {
+    if (!stat.frames) {
+        return;
+    }
+    std::cout << name << " " << count << ": " << stat.us / stat.frames
+              << " us/frame, " << stat.bytes / stat.frames << " B/frame"
+              << std::endl;
+}
+
+static void bench(RecordingCandidateWindow &window, int count) {
+    constexpr int rounds = 20;
+    Stat update, highlight, expand, scroll, collapse;
+    for (int round = 0; round < rounds; ++round) {
+        update.add(measure(window, [&] { setCandidates(count, round, 0); }));
+        highlight.add(measure(window, [&] { moveCursor(1); }));
+        // Scroll mode is only ready when there are multiple pages.
+        if (count <= pageSize) {
+            continue;
+        }
+        expand.add(measure(window, [&] { window.scroll(0, expandCount); }));
+        // Candidate window asks for more from its last row, which is not the
+        // global index once rows behind are evicted.
+        for (int loaded = expandCount; loaded < count; loaded += expandCount) {
+            scroll.add(measure(
+                window, [&] { window.scroll(window.rows(), expandCount); }));
+        }
+        collapse.add(measure(window, [&] { window.scroll(-1, 0); }));
+    }
+    report("update", count, update);
+    report("highlight", count, highlight);
+    report("expand", count, expand);
+    report("scroll", count, scroll);
+    report("collapse", count, collapse);
+}
+
+int main() {
+    RecordingCandidateWindow *window = nullptr;
+    WebPanel::setWindowFactory([&window](std::function<void()> loaded)
+                                   -> std::unique_ptr<PanelWindow> {
+        auto adapter =
+            std::make_unique<PanelWindowAdapter<RecordingCandidateWindow>>(
+                std::move(loaded));
+        window = &adapter->window();
+        return adapter;
+    });
+    start_fcitx_thread("C");
+    auto uuid = create_input_context("bench", "");
+    focus_in(uuid, false);
+    // show and hide are dispatched to main queue.
+    std::thread([uuid, window] {
+        for (int count : {10, 100, 1000, 10000}) {
+            bench(*window, count);
+        }
+        destroy_input_context(uuid);
+        stop_fcitx_thread();
+        std::exit(0);
+    }).detach();
+    dispatch_main();
+}
@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "candidate_window.hpp"
+
+namespace candidate_window {
+
+/// Headless stand-in of WebviewCandidateWindow that records every call with
+/// its payload size and time, so that WebPanel can be benchmarked without a
+/// webview. It's injected with WebPanel::setWindowFactory and
+/// PanelWindowAdapter.
+/// Callbacks are triggered by the methods simulating user actions. Thread
+/// safe, as WebPanel calls it from both fcitx and main thread.
+class RecordingCandidateWindow {
+public:
+    using Clock = std::chrono::steady_clock;
+    using Formatted = std::vector<std::pair<std::string, int>>;
+
+    struct Call {
+        std::string name;
+        size_t bytes;
+        Clock::time_point time;
+    };
+
+    explicit RecordingCandidateWindow(std::function<void()> loaded = {})
+        : loaded_(std::move(loaded)) {}
+
+    void set_layout(layout_t) { record("set_layout", sizeof(layout_t)); }
+    void set_writing_mode(writing_mode_t) {
+        record("set_writing_mode", sizeof(writing_mode_t));
+    }
+    void set_paging_buttons(bool, bool, bool) {
+        record("set_paging_buttons", 3);
+    }
+    void update_input_panel(const Formatted &preedit, int,
+                            const Formatted &auxUp,
+                            const Formatted &auxDown) {
+        record("update_input_panel", bytesOf(preedit) + sizeof(int) +
+                                         bytesOf(auxUp) + bytesOf(auxDown));
+    }
+    void set_candidates(const std::vector<Candidate> &candidates, int,
+                        scroll_state_t scrollState, bool scrollStart, bool) {
+        // Like the page, append only when scrolling.
+        if (scrollState == scroll_state_t::scrolling && !scrollStart) {
+            rows_ += candidates.size();
+        } else {
+            rows_ = candidates.size();
+        }
+        size_t bytes = sizeof(int) + sizeof(scroll_state_t) + 2;
+        for (const auto &candidate : candidates) {
+            bytes += candidate.text.size() + candidate.label.size() +
+                     candidate.comment.size() + bytesOf(candidate.actions);
+        }
+        record("set_candidates", bytes);
+    }
+    void answer_actions(const std::vector<CandidateAction> &actions) {
+        record("answer_actions", bytesOf(actions));
+    }
+    void scroll_key_action(scroll_key_action_t) {
+        record("scroll_key_action", sizeof(scroll_key_action_t));
+    }
+    void copy_html() { record("copy_html", 0); }
+    void show(double, double, double) { record("show", 3 * sizeof(double)); }
+    void hide() { record("hide", 0); }
+    void set_theme(theme_t) { record("set_theme", sizeof(theme_t)); }
+    void set_style(const char *style) {
+        record("set_style", std::strlen(style));
+    }
+    void set_native_blur(blur_t) {
+        record("set_native_blur", sizeof(blur_t));
+    }
+    void set_native_shadow(bool) { record("set_native_shadow", 1); }
+    void apply_app_accent_color(const std::string &color) {
+        record("apply_app_accent_color", color.size());
+    }
+    void set_api(uint64_t) { record("set_api", sizeof(uint64_t)); }
+    void load_plugins(const std::vector<std::string> &plugins) {
+        size_t bytes = 0;
+        for (const auto &plugin : plugins) {
+            bytes += plugin.size();
+        }
+        record("load_plugins", bytes);
+    }
+    void unload_plugins() { record("unload_plugins", 0); }
+
+    void set_select_callback(std::function<void(int)> callback) {
+        select_ = std::move(callback);
+    }
+    void set_highlight_callback(std::function<void(int)> callback) {
+        highlight_ = std::move(callback);
+    }
+    void set_page_callback(std::function<void(bool)> callback) {
+        page_ = std::move(callback);
+    }
+    void set_scroll_callback(std::function<void(int, int)> callback) {
+        scroll_ = std::move(callback);
+    }
+    void set_ask_actions_callback(std::function<void(int)> callback) {
+        askActions_ = std::move(callback);
+    }
+    void set_action_callback(std::function<void(int, int)> callback) {
+        action_ = std::move(callback);
+    }
+
+    // Simulate what the page does on user actions. Must not be called from
+    // fcitx thread, as callbacks call with_fcitx.
+    void load() { call(loaded_); }
+    void select(int index) { call(select_, index); }
+    void highlight(int index) { call(highlight_, index); }
+    void page(bool next) { call(page_, next); }
+    // start < 0 collapses.
+    void scroll(int start, int count) { call(scroll_, start, count); }
+    void askActions(int index) { call(askActions_, index); }
+    void action(int index, int id) { call(action_, index, id); }
+
+    // Candidates held by the page, i.e. where it asks for more when scrolling.
+    size_t rows() const { return rows_; }
+    size_t size() const {
+        std::lock_guard lock(mutex_);
+        return calls_.size();
+    }
+    std::vector<Call> calls(size_t from = 0) const {
+        std::lock_guard lock(mutex_);
+        return {calls_.begin() + std::min(from, calls_.size()), calls_.end()};
+    }
+    void clear() {
+        std::lock_guard lock(mutex_);
+        calls_.clear();
+    }
+    /// Wait until one of names is called at or after index from, and return
+    /// its index.
+    std::optional<size_t>
+    waitFor(std::initializer_list<std::string_view> names, size_t from,
+            std::chrono::milliseconds timeout) {
+        std::unique_lock lock(mutex_);
+        std::optional<size_t> found;
+        recorded_.wait_for(lock, timeout, [&] {
+            for (size_t i = from; i < calls_.size(); ++i) {
+                for (auto name : names) {
+                    if (calls_[i].name == name) {
+                        found = i;
+                        return true;
+                    }
+                }
+            }
+            return false;
+        });
+        return found;
+    }
+
+private:
+    mutable std::mutex mutex_;
+    std::condition_variable recorded_;
+    std::vector<Call> calls_;
+    std::atomic<size_t> rows_ = 0;
+    std::function<void()> loaded_;
+    std::function<void(int)> select_;
+    std::function<void(int)> highlight_;
+    std::function<void(bool)> page_;
+    std::function<void(int, int)> scroll_;
+    std::function<void(int)> askActions_;
+    std::function<void(int, int)> action_;
+
+    void record(std::string name, size_t bytes) {
+        {
+            std::lock_guard lock(mutex_);
+            calls_.push_back({std::move(name), bytes, Clock::now()});
+        }
+        recorded_.notify_all();
+    }
+
+    template <typename F, typename... Args>
+    static void call(const F &callback, Args... args) {
+        if (callback) {
+            callback(args...);
+        }
+    }
+
+    static size_t bytesOf(const Formatted &text) {
+        size_t bytes = 0;
+        for (const auto &[string, format] : text) {
+            bytes += string.size() + sizeof(format);
+        }
+        return bytes;
+    }
+    static size_t bytesOf(const std::vector<CandidateAction> &actions) {
+        size_t bytes = 0;
+        for (const auto &action : actions) {
+            bytes += sizeof(action.id) + action.text.size();
+        }
+        return bytes;
+    }
+};
+
+} // namespace candidate_window
@@ -0,0 +1,86 @@
+#include <string>
+#include "fcitx-utils/log.h"
+#include "fcitx/action.h"
+#include "filtercache.h"
+
+using fcitx::FilterCache;
+using fcitx::SimpleAction;
+using fcitx::Text;
+
+// Stands for chttrans converting Traditional Chinese to Simplified.
+static bool toSimplified = false;
+static int filtered = 0;
+
+static Text filter(const Text &text) {
+    ++filtered;
+    if (toSimplified && text.toString() == "發") {
+        return Text("发");
+    }
+    return text;
+}
+
+static std::string state(const std::string &inputMethod,
+                         SimpleAction &chttrans) {
+    return fcitx::filterStateKey(inputMethod, {&chttrans}, nullptr);
+}
+
+void test_toggle() {
+    FilterCache cache(16);
+    SimpleAction chttrans;
+    chttrans.setShortText("Traditional Chinese");
+    chttrans.setIcon("fcitx-chttrans-inactive");
+    auto traditional = cache.intern(state("rime", chttrans));
+    FCITX_ASSERT(cache.filter(traditional, Text("發"), filter).toString() ==
+                 "發");
+    FCITX_ASSERT(cache.filter(traditional, Text("發"), filter).toString() ==
+                 "發");
+    FCITX_ASSERT(filtered == 1);
+
+    // Toggling T -> S doesn't change how Simplified Chinese is filtered, but
+    // it changes the action, so cached results are not reused.
+    toSimplified = true;
+    chttrans.setShortText("Simplified Chinese");
+    chttrans.setIcon("fcitx-chttrans-active");
+    auto simplified = cache.intern(state("rime", chttrans));
+    FCITX_ASSERT(simplified != traditional);
+    FCITX_ASSERT(cache.filter(simplified, Text("發"), filter).toString() ==
+                 "发");
+    FCITX_ASSERT(filtered == 2);
+
+    // Toggling back finds what was filtered before.
+    toSimplified = false;
+    chttrans.setShortText("Traditional Chinese");
+    chttrans.setIcon("fcitx-chttrans-inactive");
+    FCITX_ASSERT(cache.intern(state("rime", chttrans)) == traditional);
+    FCITX_ASSERT(cache.filter(traditional, Text("發"), filter).toString() ==
+                 "發");
+    FCITX_ASSERT(filtered == 2);
+}
+
+void test_state() {
+    SimpleAction action;
+    action.setCheckable(true);
+    auto unchecked = state("rime", action);
+    action.setChecked(true);
+    FCITX_ASSERT(state("rime", action) != unchecked);
+    FCITX_ASSERT(state("pinyin", action) != state("rime", action));
+}
+
+void test_clear() {
+    FilterCache cache(16);
+    auto before = cache.intern("rime");
+    cache.insert(before, Text("發"), Text("发"));
+    cache.clear();
+    // An id held from before doesn't find entries of a new one.
+    auto after = cache.intern("pinyin");
+    FCITX_ASSERT(after != before);
+    cache.insert(after, Text("發"), Text("發"));
+    FCITX_ASSERT(!cache.find(before, Text("發")));
+}
+
+int main() {
+    test_toggle();
+    test_state();
+    test_clear();
+    return 0;
+}
@@ -28,9 +28,22 @@ void test_osx_to_fcitx() {
         (fcitx::KeyStates{} | fcitx::KeyState::Ctrl | fcitx::KeyState::Shift));
 }
 
+void test_unicode_to_keysym() {
+    // The dense table must be indistinguishable from the generic path.
+    for (uint32_t unicode = 0; unicode <= 0x10FFFF; ++unicode) {
+        FCITX_ASSERT(unicode_to_fcitx_keysym(unicode) ==
+                     fcitx::Key::keySymFromUnicode(unicode));
+    }
+    FCITX_ASSERT(unicode_to_fcitx_keysym(0x110000) ==
+                 fcitx::Key::keySymFromUnicode(0x110000));
+}
+
 void test_fcitx_to_osx() {
     FCITX_ASSERT(fcitx_keysym_to_osx_function_key(FcitxKey_Up) == 0xF700);
     FCITX_ASSERT(fcitx_keysym_to_osx_function_key(FcitxKey_F12) == 0xF70F);
+    FCITX_ASSERT(fcitx_keysym_to_osx_function_key(FcitxKey_Page_Down) ==
+                 0xF72D);
+    FCITX_ASSERT(fcitx_keysym_to_osx_function_key(FcitxKey_a) == 0);
 
     FCITX_ASSERT(fcitx_keysym_to_osx_keysym(FcitxKey_Left) == "");
     FCITX_ASSERT(fcitx_keysym_to_osx_keysym(FcitxKey_F12) == "");
@@ -45,11 +58,18 @@ void test_fcitx_to_osx() {
     FCITX_ASSERT(fcitx_keysym_to_osx_keycode(FcitxKey_Shift_L) == kVK_Shift);
     FCITX_ASSERT(fcitx_keysym_to_osx_keycode(FcitxKey_Shift_R) ==
                  kVK_RightShift);
+    FCITX_ASSERT(fcitx_keysym_to_osx_keycode(FcitxKey_Pause) == kVK_F15);
+    FCITX_ASSERT(fcitx_keysym_to_osx_keycode(FcitxKey_a) == 0);
 
     FCITX_ASSERT(fcitx_keystates_to_osx_modifiers(fcitx::KeyStates{} |
                                                   fcitx::KeyState::Super |
                                                   fcitx::KeyState::Alt) ==
                  (NSEventModifierFlagCommand | NSEventModifierFlagOption));
+    FCITX_ASSERT(fcitx_keystates_to_osx_modifiers(fcitx::KeyStates{} |
+                                                  fcitx::KeyState::Shift |
+                                                  fcitx::KeyState::NumLock) ==
+                 NSEventModifierFlagShift);
+    FCITX_ASSERT(fcitx_keystates_to_osx_modifiers(fcitx::KeyStates{}) == 0);
 }
 
 void test_fcitx_string() {
@@ -64,10 +84,23 @@ void test_fcitx_string() {
 
     FCITX_ASSERT(fcitx_string_to_osx_keycode("Alt+Shift+Shift_L") == kVK_Shift);
     FCITX_ASSERT(fcitx_string_to_osx_keycode("Shift_R") == kVK_RightShift);
+
+    auto shortcuts =
+        fcitx_keylist_to_osx_shortcuts("Control+Shift+D  F12 Shift_R Invalid");
+    FCITX_ASSERT(shortcuts.size() == 4);
+    FCITX_ASSERT(shortcuts[0].sym == 'd');
+    FCITX_ASSERT(shortcuts[0].modifiers ==
+                 (NSEventModifierFlagControl | NSEventModifierFlagShift));
+    FCITX_ASSERT(shortcuts[1].sym == 0);
+    FCITX_ASSERT(shortcuts[1].functionKey == NSF12FunctionKey);
+    FCITX_ASSERT(shortcuts[2].keycode == kVK_RightShift);
+    FCITX_ASSERT(shortcuts[3].sym == 0 && shortcuts[3].keycode == 0);
+    FCITX_ASSERT(fcitx_keylist_to_osx_shortcuts("").empty());
 }
 
 int main() {
     test_osx_to_fcitx();
+    test_unicode_to_keysym();
     test_fcitx_to_osx();
     test_fcitx_string();
 }
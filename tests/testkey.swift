@@ -16,6 +16,14 @@ func testFcitxToMac() {
   assert(fcitxStringToMacShortcut("F12") == ("", "F12"))
   assert(fcitxStringToMacShortcut("Shift+F12") == ("⇧", "F12"))
   assert(fcitxStringToMacShortcut("Super+Home") == ("⌘⤒", nil))
+  assert(fcitxStringToMacShortcut("") == ("", nil))
+
+  let shortcuts = fcitxKeyListToMacShortcuts(["Control+A", "", "Invalid", "F12"])
+  assert(shortcuts.count == 4)
+  assert(shortcuts[0]! == ("⌃A", nil))
+  assert(shortcuts[1] == nil)
+  assert(shortcuts[2] == nil)
+  assert(shortcuts[3]! == ("", "F12"))
 }
 
 @_cdecl("main")
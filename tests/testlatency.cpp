@@ -0,0 +1,44 @@
+#include "fcitx-utils/log.h"
+#include "latency.h"
+
+void test_histogram() {
+    fcitx::LatencyHistogram histogram;
+    FCITX_ASSERT(histogram.percentile(0.5) == 0);
+    for (uint64_t i = 1; i <= 100; ++i) {
+        histogram.add(i);
+    }
+    // Only the most recent samples are kept.
+    FCITX_ASSERT(histogram.size() == fcitx::LatencyHistogram::Window);
+    FCITX_ASSERT(histogram.percentile(0) == 37);
+    FCITX_ASSERT(histogram.percentile(1) == 100);
+    auto j = histogram.toJson();
+    FCITX_ASSERT(j["buckets"].size() == 2);
+    FCITX_ASSERT(j["buckets"][0][0] == 64 && j["buckets"][0][1] == 27);
+    FCITX_ASSERT(j["buckets"][1][0] == 128 && j["buckets"][1][1] == 37);
+}
+
+void test_app_latency() {
+    fcitx::AppLatency latency("Caret query", "cache", 1000);
+    for (size_t i = 1; i < fcitx::AppLatency::MinSamples; ++i) {
+        FCITX_ASSERT(!latency.record("slow", 5000));
+    }
+    FCITX_ASSERT(latency.record("slow", 5000));
+    FCITX_ASSERT(latency.fallback("slow"));
+    FCITX_ASSERT(!latency.fallback("fast"));
+    // Recovers only when median drops below half of budget.
+    for (size_t i = 0; i < fcitx::LatencyHistogram::Window; ++i) {
+        latency.record("slow", 800);
+    }
+    FCITX_ASSERT(latency.fallback("slow"));
+    for (size_t i = 0; i < fcitx::LatencyHistogram::Window; ++i) {
+        latency.record("slow", 400);
+    }
+    FCITX_ASSERT(!latency.fallback("slow"));
+    FCITX_ASSERT(latency.toJson()["slow"]["count"] ==
+                 fcitx::LatencyHistogram::Window);
+}
+
+int main() {
+    test_histogram();
+    test_app_latency();
+}
@@ -0,0 +1,105 @@
+#include <string>
+#include <vector>
+#include "fcitx-utils/log.h"
+#include "panelcommand.h"
+
+using fcitx::PanelCommand;
+
+static std::vector<std::string> history;
+
+static std::function<void()> record(std::string name) {
+    return [name] { history.push_back(name); };
+}
+
+static PanelCommand frame(const std::string &name, const std::string &commit,
+                          bool replace, bool call = true) {
+    PanelCommand command;
+    command.commit = commit;
+    command.client = [name](const std::string &commit) {
+        history.push_back(name + " client " + commit);
+    };
+    if (call) {
+        command.calls.push_back(record(name + " call"));
+    }
+    command.layout = record(name + " layout");
+    command.inputPanel = record(name + " inputPanel");
+    command.addCandidates(record(name + " candidates"), replace);
+    command.visibility = record(name + " show");
+    return command;
+}
+
+void test_run_order() {
+    history.clear();
+    auto command = frame("a", "x", true);
+    command.pagingButtons = record("a pagingButtons");
+    command.writingMode = record("a writingMode");
+    command.run();
+    std::vector<std::string> expected{
+        "a client x",    "a call",       "a pagingButtons", "a layout",
+        "a writingMode", "a inputPanel", "a candidates",    "a show"};
+    FCITX_ASSERT(history == expected);
+}
+
+static void runAll(std::vector<PanelCommand> commands) {
+    history.clear();
+    for (auto &command : commands) {
+        command.run();
+    }
+}
+
+void test_merge() {
+    fcitx::PanelMailbox mailbox;
+    FCITX_ASSERT(mailbox.post(frame("a", "x", true)));
+    FCITX_ASSERT(!mailbox.post(frame("b", "y", false, false)));
+    PanelCommand hide;
+    hide.visibility = record("c hide");
+    FCITX_ASSERT(!mailbox.post(std::move(hide)));
+    FCITX_ASSERT(mailbox.merged() == 2);
+
+    auto commands = mailbox.take();
+    FCITX_ASSERT(commands.size() == 1 && mailbox.take().empty());
+    runAll(std::move(commands));
+    // Commits are concatenated and ordered calls are kept, while the latest
+    // state wins. Appended candidates follow the replacing ones.
+    std::vector<std::string> expected{
+        "b client xy",  "a call",       "b layout", "b inputPanel",
+        "a candidates", "b candidates", "c hide"};
+    FCITX_ASSERT(history == expected);
+
+    FCITX_ASSERT(mailbox.post(frame("a", "", false)));
+    FCITX_ASSERT(!mailbox.post(frame("b", "", true, false)));
+    runAll(mailbox.take());
+    // Replacing candidates drop the pending ones.
+    expected = {"b client ",    "a call",       "b layout",
+                "b inputPanel", "b candidates", "b show"};
+    FCITX_ASSERT(history == expected);
+}
+
+void test_merge_order() {
+    fcitx::PanelMailbox mailbox;
+    // Expanding sets candidates, then a scroll key acts on them.
+    FCITX_ASSERT(mailbox.post(frame("a", "", true, false)));
+    PanelCommand key;
+    key.calls.push_back(record("b call"));
+    FCITX_ASSERT(!mailbox.post(std::move(key)));
+    FCITX_ASSERT(mailbox.merged() == 0);
+    // A frame without calls is still merged.
+    FCITX_ASSERT(!mailbox.post(frame("c", "", true, false)));
+    FCITX_ASSERT(mailbox.merged() == 1);
+
+    auto commands = mailbox.take();
+    FCITX_ASSERT(commands.size() == 2);
+    runAll(std::move(commands));
+    std::vector<std::string> expected{
+        "a client ",    "a layout",     "a inputPanel", "a candidates",
+        "a show",       "c client ",    "b call",       "c layout",
+        "c inputPanel", "c candidates", "c show"};
+    FCITX_ASSERT(history == expected);
+}
+
+int main() {
+    test_run_order();
+    test_merge();
+    test_merge_order();
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <algorithm>
+
+#include "candidateframe.h"
+
+namespace fcitx {
+
+static bool sameCandidate(const candidate_window::Candidate &a,
+                          const candidate_window::Candidate &b) {
+    return a.text == b.text && a.label == b.label && a.comment == b.comment;
+}
+
+FrameChange diffCandidateFrames(const CandidateFrame &prev,
+                                const CandidateFrame &next) {
+    if (prev.scrollState != next.scrollState ||
+        prev.scrollStart != next.scrollStart ||
+        prev.scrollEnd != next.scrollEnd || prev.layout != next.layout ||
+        prev.writingMode != next.writingMode ||
+        prev.hasActions != next.hasActions ||
+        !std::equal(prev.candidates.begin(), prev.candidates.end(),
+                    next.candidates.begin(), next.candidates.end(),
+                    sameCandidate)) {
+        return FrameChange::Changed;
+    }
+    return prev.highlighted == next.highlighted ? FrameChange::None
+                                                : FrameChange::CursorOnly;
+}
+
+} // namespace fcitx
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "candidate_window.hpp"
+
+namespace fcitx {
+
+/// Everything set_candidates renders for a page, or for the first chunk of
+/// scroll mode.
+struct CandidateFrame {
+    std::vector<candidate_window::Candidate> candidates;
+    int highlighted = -1;
+    candidate_window::scroll_state_t scrollState =
+        candidate_window::scroll_state_t::none;
+    bool scrollStart = false;
+    bool scrollEnd = false;
+    // Candidates are laid out according to these, so a change of them
+    // invalidates what is rendered.
+    candidate_window::layout_t layout = candidate_window::layout_t::horizontal;
+    candidate_window::writing_mode_t writingMode =
+        candidate_window::writing_mode_t::horizontal_tb;
+    // Whether each candidate has actions. Candidate window reads actions of
+    // paged candidates from them, so they are enumerated when the frame is
+    // sent, while scroll mode answers when asked. Empty means none has.
+    std::vector<bool> hasActions;
+};
+
+enum class FrameChange {
+    None,       // Nothing changed.
+    CursorOnly, // Only highlighted changed.
+    Changed,    // Candidates, scroll state or layout changed.
+};
+
+/// How next differs from prev. set_candidates has no partial update, so
+/// which candidates changed doesn't matter.
+FrameChange diffCandidateFrames(const CandidateFrame &prev,
+                                const CandidateFrame &next);
+
+} // namespace fcitx
@@ -0,0 +1,94 @@
+#include "filtercache.h"
+
+namespace fcitx {
+
+template <typename T>
+static void appendBytes(std::string &key, T value) {
+    key.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static void appendStringKey(std::string &key, const std::string &string) {
+    appendBytes(key, string.size());
+    key += string;
+}
+
+void appendTextKey(std::string &key, const Text &text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        appendStringKey(key, text.stringAt(i));
+        appendBytes(key, text.formatAt(i).toInteger());
+    }
+    appendBytes(key, text.cursor());
+}
+
+std::string filterStateKey(const std::string &inputMethod,
+                           const std::vector<Action *> &actions,
+                           InputContext *ic) {
+    std::string key;
+    appendStringKey(key, inputMethod);
+    for (auto *action : actions) {
+        appendStringKey(key, action->name());
+        appendStringKey(key, action->shortText(ic));
+        appendStringKey(key, action->icon(ic));
+        appendBytes(key, action->isChecked(ic));
+    }
+    return key;
+}
+
+static std::string textKey(const Text &text) {
+    std::string key;
+    appendTextKey(key, text);
+    return key;
+}
+
+FilterCache::State FilterCache::intern(const std::string &state) {
+    auto [it, inserted] = states_.try_emplace(state, nextState_);
+    if (inserted) {
+        ++nextState_;
+    }
+    return it->second;
+}
+
+Text FilterCache::filter(State state, const Text &text,
+                         const std::function<Text(const Text &)> &filter) {
+    if (const auto *value = find(state, text)) {
+        return *value;
+    }
+    auto value = filter(text);
+    insert(state, text, value);
+    return value;
+}
+
+const Text *FilterCache::find(State state, const Text &text) {
+    auto key = textKey(text);
+    auto it = index_.find({state, key});
+    if (it == index_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->value;
+}
+
+void FilterCache::insert(State state, const Text &text, Text value) {
+    auto key = textKey(text);
+    if (index_.contains({state, key})) {
+        return;
+    }
+    if (entries_.size() >= capacity_) {
+        const auto &last = entries_.back();
+        index_.erase({last.state, last.text});
+        entries_.pop_back();
+    }
+    entries_.push_front({state, std::move(key), std::move(value)});
+    const auto &entry = entries_.front();
+    index_.emplace(Key{entry.state, entry.text}, entries_.begin());
+}
+
+void FilterCache::clear() {
+    states_.clear();
+    index_.clear();
+    entries_.clear();
+}
+
+} // namespace fcitx
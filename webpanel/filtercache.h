@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <fcitx/action.h>
+#include <fcitx/text.h>
+
+namespace fcitx {
+
+/// Append bytes identifying text, including its formats and cursor, to key.
+void appendTextKey(std::string &key, const Text &text);
+
+/// Identify state of output filters for ic. Filters don't expose their state
+/// directly, but toggles like chttrans direction and full width show it in
+/// their status area actions, which are passed as actions.
+std::string filterStateKey(const std::string &inputMethod,
+                           const std::vector<Action *> &actions,
+                           InputContext *ic);
+
+/// LRU memo of output filter results, so that unchanged strings between
+/// frames are not converted again by e.g. chttrans. The same text is filtered
+/// differently when filter state differs, so callers intern a string that
+/// identifies the state and pass the returned id, which keeps entries and
+/// their hashing independent of how long the state string is.
+class FilterCache {
+public:
+    using State = uint32_t;
+
+    explicit FilterCache(size_t capacity) : capacity_(capacity) {}
+
+    // The same string gets the same id, until clear.
+    State intern(const std::string &state);
+    Text filter(State state, const Text &text,
+                const std::function<Text(const Text &)> &filter);
+    // For filtering misses of a batch together. The returned pointer is valid
+    // until next insert.
+    const Text *find(State state, const Text &text);
+    void insert(State state, const Text &text, Text value);
+    // Filters are reconfigured. Ids interned before never match again.
+    void clear();
+
+    size_t hits() const { return hits_; }
+    size_t misses() const { return misses_; }
+
+private:
+    struct Entry {
+        State state;
+        std::string text;
+        Text value;
+    };
+    // Texts point into entries_.
+    struct Key {
+        State state;
+        std::string_view text;
+        bool operator==(const Key &other) const = default;
+    };
+    struct KeyHash {
+        size_t operator()(const Key &key) const {
+            return std::hash<std::string_view>()(key.text) * 31 + key.state;
+        }
+    };
+    size_t capacity_;
+    std::unordered_map<std::string, State> states_;
+    State nextState_ = 0;
+    // Most recently used first.
+    std::list<Entry> entries_;
+    std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+    size_t hits_ = 0;
+    size_t misses_ = 0;
+};
+
+} // namespace fcitx
@@ -0,0 +1,76 @@
+#include "keytable.h"
+
+namespace fcitx {
+
+static bool applicable(PanelKeyAction action,
+                       candidate_window::scroll_state_t scrollState) {
+    switch (action) {
+    case PanelKeyAction::CopyHtml:
+        return true;
+    case PanelKeyAction::Expand:
+        return scrollState == candidate_window::scroll_state_t::ready;
+    case PanelKeyAction::Scroll:
+    case PanelKeyAction::Swallow:
+        return scrollState == candidate_window::scroll_state_t::scrolling;
+    }
+    return false;
+}
+
+static const PanelKeyBinding *
+findIn(const std::vector<PanelKeyBinding> &bindings, const Key &key,
+       candidate_window::scroll_state_t scrollState) {
+    for (const auto &binding : bindings) {
+        if (applicable(binding.action, scrollState) &&
+            key.check(binding.key)) {
+            return &binding;
+        }
+    }
+    return nullptr;
+}
+
+void PanelKeyTable::clear() {
+    bySym_.clear();
+    byCode_.clear();
+    size_ = 0;
+}
+
+void PanelKeyTable::add(const Key &key, PanelKeyAction action,
+                        candidate_window::scroll_key_action_t scrollAction,
+                        bool filterRelease) {
+    PanelKeyBinding binding{key, action, scrollAction, filterRelease, size_++};
+    if (key.code()) {
+        byCode_.push_back(binding);
+        return;
+    }
+    // Key::check never matches these.
+    if (key.sym() == FcitxKey_None || key.sym() == FcitxKey_VoidSymbol) {
+        return;
+    }
+    bySym_[key.sym()].push_back(binding);
+}
+
+void PanelKeyTable::add(const KeyList &keys, PanelKeyAction action,
+                        candidate_window::scroll_key_action_t scrollAction,
+                        bool filterRelease) {
+    for (const auto &key : keys) {
+        add(key, action, scrollAction, filterRelease);
+    }
+}
+
+const PanelKeyBinding *
+PanelKeyTable::find(const Key &key,
+                    candidate_window::scroll_state_t scrollState) const {
+    const PanelKeyBinding *ret = nullptr;
+    if (auto it = bySym_.find(key.sym()); it != bySym_.end()) {
+        ret = findIn(it->second, key, scrollState);
+    }
+    if (!byCode_.empty()) {
+        if (auto binding = findIn(byCode_, key, scrollState);
+            binding && (!ret || binding->order < ret->order)) {
+            ret = binding;
+        }
+    }
+    return ret;
+}
+
+} // namespace fcitx
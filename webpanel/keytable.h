@@ -0,0 +1,44 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+#include <fcitx-utils/key.h>
+
+#include "candidate_window.hpp"
+
+namespace fcitx {
+
+enum class PanelKeyAction { CopyHtml, Expand, Scroll, Swallow };
+
+struct PanelKeyBinding {
+    Key key;
+    PanelKeyAction action;
+    candidate_window::scroll_key_action_t scrollAction;
+    // Release of some keys must not reach engine, which resets scroll mode.
+    bool filterRelease;
+    size_t order;
+};
+
+/// Key bindings of WebPanel compiled from config, so that a key event is
+/// dispatched with one hash lookup instead of walking every KeyList option.
+/// Bindings are matched with Key::check, and the first added wins.
+class PanelKeyTable {
+public:
+    void clear();
+    void add(const Key &key, PanelKeyAction action,
+             candidate_window::scroll_key_action_t scrollAction = {},
+             bool filterRelease = false);
+    void add(const KeyList &keys, PanelKeyAction action,
+             candidate_window::scroll_key_action_t scrollAction = {},
+             bool filterRelease = false);
+    const PanelKeyBinding *
+    find(const Key &key, candidate_window::scroll_state_t scrollState) const;
+
+private:
+    std::unordered_map<KeySym, std::vector<PanelKeyBinding>> bySym_;
+    // Key code based bindings can't be indexed by sym.
+    std::vector<PanelKeyBinding> byCode_;
+    size_t size_ = 0;
+};
+
+} // namespace fcitx
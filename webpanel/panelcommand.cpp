@@ -0,0 +1,104 @@
+#include <utility>
+
+#include "panelcommand.h"
+
+namespace fcitx {
+
+bool PanelCommand::empty() const {
+    return commit.empty() && !client && calls.empty() && !pagingButtons &&
+           !layout && !writingMode && !inputPanel && candidates.empty() &&
+           !visibility;
+}
+
+void PanelCommand::addCandidates(std::function<void()> call, bool replace) {
+    if (replace) {
+        candidates.clear();
+        candidatesReplace = true;
+    }
+    candidates.push_back(std::move(call));
+}
+
+bool PanelCommand::canMerge(const PanelCommand &newer) const {
+    return newer.calls.empty() ||
+           (!pagingButtons && !layout && !writingMode && !inputPanel &&
+            candidates.empty() && !visibility);
+}
+
+template <typename T>
+static void replaceIfSet(std::function<T> &older, std::function<T> &&newer) {
+    if (newer) {
+        older = std::move(newer);
+    }
+}
+
+void PanelCommand::merge(PanelCommand &&newer) {
+    commit += newer.commit;
+    replaceIfSet(client, std::move(newer.client));
+    for (auto &call : newer.calls) {
+        calls.push_back(std::move(call));
+    }
+    replaceIfSet(pagingButtons, std::move(newer.pagingButtons));
+    replaceIfSet(layout, std::move(newer.layout));
+    replaceIfSet(writingMode, std::move(newer.writingMode));
+    replaceIfSet(inputPanel, std::move(newer.inputPanel));
+    if (newer.candidatesReplace) {
+        candidates = std::move(newer.candidates);
+        candidatesReplace = true;
+    } else {
+        for (auto &call : newer.candidates) {
+            candidates.push_back(std::move(call));
+        }
+    }
+    replaceIfSet(visibility, std::move(newer.visibility));
+}
+
+void PanelCommand::run() {
+    if (client) {
+        client(commit);
+    }
+    for (const auto &call : calls) {
+        call();
+    }
+    if (pagingButtons) {
+        pagingButtons();
+    }
+    // Candidates are laid out according to current layout.
+    if (layout) {
+        layout();
+    }
+    if (writingMode) {
+        writingMode();
+    }
+    if (inputPanel) {
+        inputPanel();
+    }
+    for (const auto &call : candidates) {
+        call();
+    }
+    // Caret is read after client preedit is set.
+    if (visibility) {
+        visibility();
+    }
+}
+
+bool PanelMailbox::post(PanelCommand &&command) {
+    std::lock_guard lock(mutex_);
+    if (pending_.empty()) {
+        pending_.push_back(std::move(command));
+        return true;
+    }
+    if (pending_.back().canMerge(command)) {
+        pending_.back().merge(std::move(command));
+        ++merged_;
+    } else {
+        pending_.push_back(std::move(command));
+    }
+    return false;
+}
+
+std::vector<PanelCommand> PanelMailbox::take() {
+    std::lock_guard lock(mutex_);
+    return std::exchange(pending_, {});
+}
+
+} // namespace fcitx
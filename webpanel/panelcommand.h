@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fcitx {
+
+/// Main thread side effects of one panel frame, collected in fcitx thread.
+/// Each component is a call bringing the window to its state in this frame,
+/// so that of a newer frame replaces it. Commits and ordered calls of all
+/// frames are kept, and a frame is only merged if its calls don't overtake
+/// states of older frames.
+struct PanelCommand {
+    // Commit of async events, concatenated across frames, and passed to
+    // client, which also sets the latest preedit.
+    std::string commit;
+    std::function<void(const std::string &commit)> client;
+    // Calls that must all run in order, e.g. config changes and answers to
+    // candidate window.
+    std::vector<std::function<void()>> calls;
+    std::function<void()> pagingButtons;
+    std::function<void()> layout;
+    std::function<void()> writingMode;
+    std::function<void()> inputPanel;
+    // If candidatesReplace, the first call replaces candidates of window,
+    // otherwise all calls append to them.
+    std::vector<std::function<void()>> candidates;
+    bool candidatesReplace = false;
+    // Show or hide.
+    std::function<void()> visibility;
+
+    bool empty() const;
+    void addCandidates(std::function<void()> call, bool replace);
+    // Whether merging newer keeps the order of effects, i.e. calls of newer
+    // don't run before states of this, e.g. a scroll key after expanding.
+    bool canMerge(const PanelCommand &newer) const;
+    // Fold newer into this, so that running this is the same as running
+    // both, minus states overwritten by newer.
+    void merge(PanelCommand &&newer);
+    void run();
+};
+
+/// Holds commands not yet run by main thread. Later frames are merged into
+/// the last one when order allows, so that main thread doesn't draw stale
+/// frames one after another when it falls behind.
+class PanelMailbox {
+public:
+    // Return true if main thread must be notified to take them, i.e. nothing
+    // was pending.
+    bool post(PanelCommand &&command);
+    // Commands to run in order.
+    std::vector<PanelCommand> take();
+    // Frames merged into a pending one.
+    uint64_t merged() const { return merged_; }
+
+private:
+    std::mutex mutex_;
+    std::vector<PanelCommand> pending_;
+    std::atomic<uint64_t> merged_ = 0;
+};
+
+} // namespace fcitx
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "candidate_window.hpp"
+
+namespace fcitx {
+
+/// Candidate window as WebPanel uses it, so that a headless window can stand
+/// in for WebviewCandidateWindow, e.g. to benchmark WebPanel. Methods are
+/// named after those of WebviewCandidateWindow.
+class PanelWindow {
+public:
+    using Formatted = std::vector<std::pair<std::string, int>>;
+
+    virtual ~PanelWindow() = default;
+
+    virtual void set_layout(candidate_window::layout_t layout) = 0;
+    virtual void
+    set_writing_mode(candidate_window::writing_mode_t writingMode) = 0;
+    virtual void set_paging_buttons(bool pageable, bool hasPrev,
+                                    bool hasNext) = 0;
+    virtual void update_input_panel(const Formatted &preedit, int cursor,
+                                    const Formatted &auxUp,
+                                    const Formatted &auxDown) = 0;
+    virtual void
+    set_candidates(const std::vector<candidate_window::Candidate> &candidates,
+                   int highlighted,
+                   candidate_window::scroll_state_t scrollState,
+                   bool scrollStart, bool scrollEnd) = 0;
+    virtual void answer_actions(
+        const std::vector<candidate_window::CandidateAction> &actions) = 0;
+    virtual void
+    scroll_key_action(candidate_window::scroll_key_action_t action) = 0;
+    virtual void copy_html() = 0;
+    virtual void show(double x, double y, double height) = 0;
+    virtual void hide() = 0;
+    virtual void set_theme(candidate_window::theme_t theme) = 0;
+    virtual void set_style(const char *style) = 0;
+    virtual void set_native_blur(candidate_window::blur_t blur) = 0;
+    virtual void apply_app_accent_color(const std::string &color) = 0;
+    virtual void set_api(uint64_t apis) = 0;
+    virtual void load_plugins(const std::vector<std::string> &plugins) = 0;
+    virtual void unload_plugins() = 0;
+
+    virtual void set_select_callback(std::function<void(int)> callback) = 0;
+    virtual void set_highlight_callback(std::function<void(int)> callback) = 0;
+    virtual void set_page_callback(std::function<void(bool)> callback) = 0;
+    virtual void
+    set_scroll_callback(std::function<void(int, int)> callback) = 0;
+    virtual void
+    set_ask_actions_callback(std::function<void(int)> callback) = 0;
+    virtual void
+    set_action_callback(std::function<void(int, int)> callback) = 0;
+};
+
+/// Creates a window, which calls loaded once its page is loaded.
+using PanelWindowFactory = std::function<std::unique_ptr<PanelWindow>(
+    std::function<void()> loaded)>;
+
+/// PanelWindow of a Window that has the same methods, e.g.
+/// WebviewCandidateWindow.
+template <typename Window>
+class PanelWindowAdapter final : public PanelWindow {
+public:
+    explicit PanelWindowAdapter(std::function<void()> loaded)
+        : window_(std::move(loaded)) {}
+
+    Window &window() { return window_; }
+
+    void set_layout(candidate_window::layout_t layout) override {
+        window_.set_layout(layout);
+    }
+    void
+    set_writing_mode(candidate_window::writing_mode_t writingMode) override {
+        window_.set_writing_mode(writingMode);
+    }
+    void set_paging_buttons(bool pageable, bool hasPrev,
+                            bool hasNext) override {
+        window_.set_paging_buttons(pageable, hasPrev, hasNext);
+    }
+    void update_input_panel(const Formatted &preedit, int cursor,
+                            const Formatted &auxUp,
+                            const Formatted &auxDown) override {
+        window_.update_input_panel(preedit, cursor, auxUp, auxDown);
+    }
+    void
+    set_candidates(const std::vector<candidate_window::Candidate> &candidates,
+                   int highlighted,
+                   candidate_window::scroll_state_t scrollState,
+                   bool scrollStart, bool scrollEnd) override {
+        window_.set_candidates(candidates, highlighted, scrollState,
+                               scrollStart, scrollEnd);
+    }
+    void answer_actions(const std::vector<candidate_window::CandidateAction>
+                            &actions) override {
+        window_.answer_actions(actions);
+    }
+    void
+    scroll_key_action(candidate_window::scroll_key_action_t action) override {
+        window_.scroll_key_action(action);
+    }
+    void copy_html() override { window_.copy_html(); }
+    void show(double x, double y, double height) override {
+        window_.show(x, y, height);
+    }
+    void hide() override { window_.hide(); }
+    void set_theme(candidate_window::theme_t theme) override {
+        window_.set_theme(theme);
+    }
+    void set_style(const char *style) override { window_.set_style(style); }
+    void set_native_blur(candidate_window::blur_t blur) override {
+        window_.set_native_blur(blur);
+    }
+    void apply_app_accent_color(const std::string &color) override {
+        window_.apply_app_accent_color(color);
+    }
+    void set_api(uint64_t apis) override { window_.set_api(apis); }
+    void load_plugins(const std::vector<std::string> &plugins) override {
+        window_.load_plugins(plugins);
+    }
+    void unload_plugins() override { window_.unload_plugins(); }
+
+    void set_select_callback(std::function<void(int)> callback) override {
+        window_.set_select_callback(std::move(callback));
+    }
+    void set_highlight_callback(std::function<void(int)> callback) override {
+        window_.set_highlight_callback(std::move(callback));
+    }
+    void set_page_callback(std::function<void(bool)> callback) override {
+        window_.set_page_callback(std::move(callback));
+    }
+    void set_scroll_callback(std::function<void(int, int)> callback) override {
+        window_.set_scroll_callback(std::move(callback));
+    }
+    void set_ask_actions_callback(std::function<void(int)> callback) override {
+        window_.set_ask_actions_callback(std::move(callback));
+    }
+    void set_action_callback(std::function<void(int, int)> callback) override {
+        window_.set_action_callback(std::move(callback));
+    }
+
+private:
+    Window window_;
+};
+
+} // namespace fcitx
@@ -0,0 +1,69 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <fcitx-utils/log.h>
+#include <nlohmann/json.hpp>
+
+#include "stylecache.h"
+
+namespace fcitx {
+
+static std::string readFile(const std::filesystem::path &path) {
+    std::ifstream file(path, std::ios::binary);
+    return {std::istreambuf_iterator<char>(file),
+            std::istreambuf_iterator<char>()};
+}
+
+/// FNV-1a, which is stable across runs unlike std::hash.
+static uint64_t hash(const std::string &data) {
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        h = (h ^ c) * 1099511628211ULL;
+    }
+    return h;
+}
+
+// Theme and DefaultTheme are in the config file, so they are covered.
+std::string StyleCache::key() const {
+    return std::to_string(hash(readFile(configPath_)));
+}
+
+std::optional<std::string> StyleCache::load() const {
+    auto content = readFile(cachePath_);
+    if (content.empty()) {
+        return std::nullopt;
+    }
+    try {
+        auto j = nlohmann::json::parse(content);
+        if (j.at("key").get<std::string>() != key()) {
+            return std::nullopt;
+        }
+        return j.at("style").get<std::string>();
+    } catch (const std::exception &e) {
+        FCITX_WARN() << "Invalid style cache " << cachePath_.string();
+        return std::nullopt;
+    }
+}
+
+void StyleCache::save(const std::string &style) const {
+    nlohmann::json j{{"key", key()}, {"style", style}};
+    std::error_code ec;
+    std::filesystem::create_directories(cachePath_.parent_path(), ec);
+    // Write to a temporary file so that a reader never sees a partial one.
+    auto tmp = cachePath_;
+    tmp += ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file << j.dump();
+        if (!file) {
+            FCITX_WARN() << "Failed to write style cache " << tmp.string();
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, cachePath_, ec);
+    if (ec) {
+        FCITX_WARN() << "Failed to save style cache " << cachePath_.string();
+    }
+}
+
+} // namespace fcitx
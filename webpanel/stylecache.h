@@ -0,0 +1,30 @@
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string>
+
+namespace fcitx {
+
+/// Style payload last sent to candidate window, saved with a hash of the
+/// config file it's generated from. When the page loads, a cached payload of
+/// the unchanged config is applied right away in main thread, instead of
+/// waiting for fcitx thread, which may still be busy starting up.
+class StyleCache {
+public:
+    StyleCache(std::filesystem::path configPath,
+               std::filesystem::path cachePath)
+        : configPath_(std::move(configPath)),
+          cachePath_(std::move(cachePath)) {}
+
+    // Style cached for current config file, if any.
+    std::optional<std::string> load() const;
+    void save(const std::string &style) const;
+
+private:
+    std::filesystem::path configPath_;
+    std::filesystem::path cachePath_;
+    std::string key() const;
+};
+
+} // namespace fcitx
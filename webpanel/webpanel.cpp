@@ -1,315 +1,458 @@
+#include <algorithm>
+#include <utility>
 #include <fcitx/inputpanel.h>
+#include <fcitx/statusarea.h>
 
 #include "fcitx.h"
 #include "../macosfrontend/macosfrontend.h"
 #include "config/config.h"
 #include "webpanel.h"
+#include "webview_candidate_window.hpp"
 
 namespace fcitx {
 
+static std::vector<candidate_window::CandidateAction>
+candidateActions(const ActionableCandidateList *actionableList,
+                 const CandidateWord &candidate) {
+    std::vector<candidate_window::CandidateAction> actions;
+    for (const auto &action : actionableList->candidateActions(candidate)) {
+        actions.push_back({action.id(), action.text()});
+    }
+    return actions;
+}
+
+static PanelWindowFactory &windowFactory() {
+    static PanelWindowFactory factory = [](std::function<void()> loaded) {
+        return std::make_unique<
+            PanelWindowAdapter<candidate_window::WebviewCandidateWindow>>(
+            std::move(loaded));
+    };
+    return factory;
+}
+
+void WebPanel::setWindowFactory(PanelWindowFactory factory) {
+    windowFactory() = std::move(factory);
+}
+
 WebPanel::WebPanel(Instance *instance)
     : instance_(instance),
-      window_(std::make_unique<candidate_window::WebviewCandidateWindow>(
-          [this]() { with_fcitx([&](Fcitx &fcitx) { reloadConfig(); }); })) {
+      window_(windowFactory()([this]() {
+          // fcitx thread may be busy e.g. loading addons after login.
+          auto style = styleCache_.load();
+          if (style) {
+              window_->set_style(style->c_str());
+          }
+          with_fcitx([&](Fcitx &fcitx) {
+              // Page is loaded without any config applied.
+              appliedConfig_ = nullptr;
+              sentStyle_ = style.value_or("");
+              reloadConfig();
+          });
+      })) {
+    // Callbacks are posted to fcitx thread so that main thread never waits
+    // for engine to report a mouse event.
     window_->set_select_callback([this](int index) {
-        with_fcitx([&](Fcitx &fcitx) {
-            auto ic = instance_->mostRecentInputContext();
+        post([=, this](InputContext *ic) {
             const auto &list = ic->inputPanel().candidateList();
             if (!list)
                 return;
-            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
-                const auto &bulk = list->toBulk();
-                if (!bulk) {
-                    return;
-                }
-                try {
-                    bulk->candidateFromAll(index).select(ic);
-                } catch (const std::invalid_argument &e) {
-                    FCITX_ERROR() << "select candidate index out of range";
-                }
-                return;
-            }
-            try {
-                // Engine is responsible for updating UI
-                list->candidate(index).select(ic);
-            } catch (const std::invalid_argument &e) {
+            auto *candidate = candidateAt(list, index);
+            if (!candidate) {
                 FCITX_ERROR() << "select candidate index out of range";
+                return;
             }
+            // Engine is responsible for updating UI
+            candidate->select(ic);
         });
     });
     window_->set_highlight_callback([this](int index) {
-        with_fcitx([&](Fcitx &fcitx) {
-            auto ic = instance_->mostRecentInputContext();
-            const auto &list = ic->inputPanel().candidateList();
-            if (!list)
-                return;
-            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
-                const auto bulkCursor = list->toBulkCursor();
-                if (!bulkCursor) {
+        ++metrics_.generatedHighlights;
+        pendingHighlight_ = {index, windowCandidatesId_};
+        if (!highlightThrottled_) {
+            flushHighlight();
+        }
+    });
+    // Each click pages from wherever the list is then, so none is dropped.
+    window_->set_page_callback([this](bool next) {
+        post(
+            [=](InputContext *ic) {
+                const auto &list = ic->inputPanel().candidateList();
+                if (!list)
                     return;
+                auto *pageableList = list->toPageable();
+                if (!pageableList)
+                    return;
+                if (next) {
+                    pageableList->next();
+                } else {
+                    pageableList->prev();
                 }
-                try {
-                    bulkCursor->setGlobalCursorIndex(index);
-                } catch (const std::invalid_argument &e) {
-                    FCITX_ERROR() << "highlight candidate index out of range";
-                }
-            }
-        });
+                // UI is responsible for updating UI
+                ic->updateUserInterface(UserInterfaceComponent::InputPanel);
+            },
+            false);
     });
-    window_->set_page_callback([this](bool next) {
-        with_fcitx([&](Fcitx &fcitx) {
-            auto ic = instance_->mostRecentInputContext();
+    window_->set_scroll_callback([this](int start, int count) {
+        // Expanding and collapsing don't refer to any loaded candidate.
+        post(
+            [=, this](InputContext *) {
+                scroll(start <= 0 ? start : toGlobalIndex(start), count);
+            },
+            start > 0);
+    });
+    window_->set_ask_actions_callback([this](int index) {
+        post([=, this](InputContext *ic) {
             const auto &list = ic->inputPanel().candidateList();
             if (!list)
                 return;
-            auto *pageableList = list->toPageable();
-            if (!pageableList)
+            auto *actionableList = list->toActionable();
+            if (!actionableList) {
                 return;
-            if (next) {
-                pageableList->next();
-            } else {
-                pageableList->prev();
             }
-            // UI is responsible for updating UI
-            ic->updateUserInterface(UserInterfaceComponent::InputPanel);
-        });
-    });
-    window_->set_scroll_callback([this](int start, int count) {
-        with_fcitx([=, this](Fcitx &fcitx) { scroll(start, count); });
-    });
-    window_->set_ask_actions_callback([&](int index) {
-        with_fcitx([&](Fcitx &fcitx) {
-            auto ic = instance_->mostRecentInputContext();
-            const auto &list = ic->inputPanel().candidateList();
-            if (!list)
+            // Candidate window may ask for a paged candidate too.
+            auto *candidate = candidateAt(list, index);
+            if (!candidate) {
+                FCITX_ERROR() << "action candidate index out of range";
                 return;
-            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
-                const auto &bulk = list->toBulk();
-                if (!bulk) {
-                    return;
-                }
-                auto *actionableList = list->toActionable();
-                if (!actionableList) {
-                    return;
-                }
-                try {
-                    auto &candidate = bulk->candidateFromAll(index);
-                    if (actionableList->hasAction(candidate)) {
-                        std::vector<candidate_window::CandidateAction> actions;
-                        for (const auto &action :
-                             actionableList->candidateActions(candidate)) {
-                            actions.push_back({action.id(), action.text()});
-                        }
-                        dispatch_async(dispatch_get_main_queue(), ^{
-                          window_->answer_actions(actions);
-                        });
-                    }
-                } catch (const std::invalid_argument &e) {
-                    FCITX_ERROR() << "action candidate index out of range";
-                }
             }
+            if (!actionableList->hasAction(*candidate)) {
+                return;
+            }
+            // Actions are enumerated only when asked for, e.g. on right
+            // click, and kept until candidates are replaced.
+            if (actionsId_ != candidatesId_) {
+                actions_.clear();
+                actionsId_ = candidatesId_;
+            }
+            auto it = actions_.find(index);
+            if (it == actions_.end()) {
+                it = actions_
+                         .emplace(index,
+                                  candidateActions(actionableList, *candidate))
+                         .first;
+            }
+            command().calls.push_back([this, actions = it->second] {
+                window_->answer_actions(actions);
+            });
         });
     });
     window_->set_action_callback([this](int index, int id) {
-        with_fcitx([&](Fcitx &fcitx) {
-            auto ic = instance_->mostRecentInputContext();
+        post([=, this](InputContext *ic) {
             const auto &list = ic->inputPanel().candidateList();
             if (!list)
                 return;
             auto *actionableList = list->toActionable();
             if (!actionableList)
                 return;
-            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
-                const auto &bulk = list->toBulk();
-                if (!bulk) {
-                    return;
-                }
-                try {
-                    const auto &candidate = bulk->candidateFromAll(index);
-                    if (actionableList->hasAction(candidate)) {
-                        actionableList->triggerAction(candidate, id);
-                    }
-                } catch (const std::invalid_argument &e) {
-                    FCITX_ERROR() << "action candidate index out of range";
-                }
+            auto *candidate = candidateAt(list, index);
+            if (!candidate) {
+                FCITX_ERROR() << "action candidate index out of range";
                 return;
             }
-            try {
-                const auto &candidate = list->candidate(index);
-                if (actionableList->hasAction(candidate)) {
-                    actionableList->triggerAction(candidate, id);
-                }
-            } catch (const std::invalid_argument &e) {
-                FCITX_ERROR() << "action candidate index out of range";
+            if (actionableList->hasAction(*candidate)) {
+                actionableList->triggerAction(*candidate, id);
             }
         });
     });
+    // Events that may change state of output filters, e.g. toggling chttrans.
+    for (auto type :
+         {EventType::InputContextKeyEvent, EventType::InputContextFocusIn,
+          EventType::InputContextSwitchInputMethod,
+          EventType::InputContextInvokeAction}) {
+        filterEventHandlers_.emplace_back(instance_->watchEvent(
+            type, EventWatcherPhase::PreInputMethod,
+            [this](Event &) { invalidateFilterState(); }));
+    }
+    filterEventHandlers_.emplace_back(instance_->watchEvent(
+        EventType::GlobalConfigReloaded, EventWatcherPhase::Default,
+        [this](Event &) { clearFilterCache(); }));
+    commitEventHandler_ = instance_->watchEvent(
+        EventType::InputContextCommitString, EventWatcherPhase::Default,
+        [this](Event &) { delayHide_ = true; });
     eventHandler_ = instance_->watchEvent(
         EventType::InputContextKeyEvent, EventWatcherPhase::PreInputMethod,
         [this](Event &event) {
             auto &keyEvent = static_cast<KeyEvent &>(event);
-            const auto key = keyEvent.key();
-            if (key.checkKeyList(*config_.advanced->copyHtml)) {
-                if (keyEvent.isRelease()) {
-                    return;
-                }
-                dispatch_async(dispatch_get_main_queue(), ^{
-                  window_->copy_html();
-                });
-                return keyEvent.filterAndAccept();
+            const auto *binding = keyTable_.find(keyEvent.key(), scrollState_);
+            if (!binding) {
+                return;
             }
-            if (scrollState_ == candidate_window::scroll_state_t::ready &&
-                key.checkKeyList(*config_.scrollMode->expand)) {
-                if (keyEvent.isRelease()) {
-                    return;
+            if (keyEvent.isRelease()) {
+                if (binding->filterRelease) {
+                    keyEvent.filterAndAccept();
                 }
-                expand();
-                return keyEvent.filterAndAccept();
+                return;
             }
-            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
-                static const std::vector<candidate_window::scroll_key_action_t>
-                    selectActions = {
-                        candidate_window::scroll_key_action_t::one,
-                        candidate_window::scroll_key_action_t::two,
-                        candidate_window::scroll_key_action_t::three,
-                        candidate_window::scroll_key_action_t::four,
-                        candidate_window::scroll_key_action_t::five,
-                        candidate_window::scroll_key_action_t::six,
-                        candidate_window::scroll_key_action_t::seven,
-                        candidate_window::scroll_key_action_t::eight,
-                        candidate_window::scroll_key_action_t::nine,
-                        candidate_window::scroll_key_action_t::zero,
-                    };
-                static const KeyList mainKeyboardNumberKeys = {
-                    Key(FcitxKey_1), Key(FcitxKey_2), Key(FcitxKey_3),
-                    Key(FcitxKey_4), Key(FcitxKey_5), Key(FcitxKey_6),
-                    Key(FcitxKey_7), Key(FcitxKey_8), Key(FcitxKey_9),
-                    Key(FcitxKey_0)};
-                static const KeyList keypadNumberKeys = {
-                    Key(FcitxKey_KP_1), Key(FcitxKey_KP_2), Key(FcitxKey_KP_3),
-                    Key(FcitxKey_KP_4), Key(FcitxKey_KP_5), Key(FcitxKey_KP_6),
-                    Key(FcitxKey_KP_7), Key(FcitxKey_KP_8), Key(FcitxKey_KP_9),
-                    Key(FcitxKey_KP_0)};
-                int keyIndex = -1;
-                if (int i =
-                        key.keyListIndex(*config_.scrollMode->selectCandidate);
-                    i >= 0 && i < 10) {
-                    keyIndex = i;
-                }
-                if (keyIndex < 0 &&
-                    *config_.scrollMode->useMainKeyboardNumberKeys) {
-                    int i = key.keyListIndex(mainKeyboardNumberKeys);
-                    if (i >= 0 && i < 10) {
-                        keyIndex = i;
-                    }
-                }
-                if (keyIndex < 0 && *config_.scrollMode->useKeypadNumberKeys) {
-                    int i = key.keyListIndex(keypadNumberKeys);
-                    if (i >= 0 && i < 10) {
-                        keyIndex = i;
-                    }
-                }
-                if (keyIndex >= 0) {
-                    if (keyEvent.isRelease()) {
-                        return;
-                    }
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                      window_->scroll_key_action(selectActions[keyIndex]);
-                    });
-                    return keyEvent.filterAndAccept();
-                }
-                const std::vector<std::pair<
-                    Option<KeyList>, candidate_window::scroll_key_action_t>>
-                    actionMap = {
-                        {config_.scrollMode->up,
-                         candidate_window::scroll_key_action_t::up},
-                        {config_.scrollMode->down,
-                         candidate_window::scroll_key_action_t::down},
-                        {config_.scrollMode->left,
-                         candidate_window::scroll_key_action_t::left},
-                        {config_.scrollMode->right,
-                         candidate_window::scroll_key_action_t::right},
-                        {config_.scrollMode->rowStart,
-                         candidate_window::scroll_key_action_t::home},
-                        {config_.scrollMode->rowEnd,
-                         candidate_window::scroll_key_action_t::end},
-                        {config_.scrollMode->pageUp,
-                         candidate_window::scroll_key_action_t::page_up},
-                        {config_.scrollMode->pageDown,
-                         candidate_window::scroll_key_action_t::page_down},
-                        {config_.scrollMode->commit,
-                         candidate_window::scroll_key_action_t::commit},
-                    }; // Can't be static because config could be modified.
-                for (const auto &pair : actionMap) {
-                    if (key.checkKeyList(*pair.first)) {
-                        if (!keyEvent.isRelease()) {
-                            auto captured = pair.second;
-                            dispatch_async(dispatch_get_main_queue(), ^{
-                              window_->scroll_key_action(captured);
-                            });
-                        }
-                        // Must not send release event to engine, which resets
-                        // scroll mode.
-                        return keyEvent.filterAndAccept();
-                    }
-                }
-                if (key.checkKeyList(*config_.scrollMode->collapse)) {
-                    if (keyEvent.isRelease()) {
-                        return;
-                    }
-                    // Instead of directly calling collapse, let webview handle
-                    // animation and call it.
-                    dispatch_async(dispatch_get_main_queue(), ^{
-                      window_->scroll_key_action(
-                          candidate_window::scroll_key_action_t::collapse);
+            switch (binding->action) {
+            case PanelKeyAction::CopyHtml:
+                command().calls.push_back([this] { window_->copy_html(); });
+                break;
+            case PanelKeyAction::Expand:
+                expand();
+                break;
+            case PanelKeyAction::Scroll:
+                command().calls.push_back(
+                    [this, action = binding->scrollAction] {
+                        window_->scroll_key_action(action);
                     });
-                    return keyEvent.filterAndAccept();
-                }
-                // Karabiner-Elements defines Hyper as Ctrl+Alt+Shift+Cmd, but
-                // its combinations cause fcitx5-rime to reset candidates. This
-                // is because librime's process_key returns 0 event if a key
-                // event (Shift) is handled, thus fcitx5-rime can't use the
-                // retval to decide update UI or not.
-                static std::vector<Key> hyperModifiers = {
-                    Key("Super+Super_L"),
-                    Key("Control+Super+Control_L"),
-                    Key("Control+Alt+Super+Alt_L"),
-                    Key("Control+Alt+Shift+Super+Shift_L"),
-                    Key("Alt+Shift+Super+Control_L"),
-                    Key("Alt+Super+Shift_L"),
-                    Key("Super+Alt_L"),
-                    Key("Super_L"),
-                    Key("Control+Control_L"),
-                    Key("Control+Alt+Alt_L"),
-                    Key("Control+Alt+Super+Super_L"),
-                    Key("Alt+Super+Control_L"),
-                }; // keys received by Fcitx5 when CapsLock (Hyper) is pressed
-                if (*config_.scrollMode->optimizeForHyperKey &&
-                    key.checkKeyList(hyperModifiers)) {
-                    return keyEvent.filterAndAccept();
-                }
+                break;
+            case PanelKeyAction::Swallow:
+                break;
             }
+            keyEvent.filterAndAccept();
         });
 }
 
+/// Called in main thread. The candidates callback refers to are those the
+/// candidate window has received, and it's dropped if they are replaced
+/// before it runs.
+void WebPanel::post(std::function<void(InputContext *)> callback,
+                    bool indexed) {
+    uint64_t id = windowCandidatesId_;
+    Fcitx::shared().schedule(
+        [this, id, indexed, callback = std::move(callback)] {
+            if (indexed && id != candidatesId_) {
+                ++metrics_.staleCallbacks;
+                return;
+            }
+            if (auto *ic = instance_->mostRecentInputContext()) {
+                callback(ic);
+            }
+        });
+}
+
+/// Called in main thread. Hovering generates a highlight per mouse move, but
+/// only the latest one of each display frame reaches engine.
+void WebPanel::flushHighlight() {
+    if (!pendingHighlight_) {
+        highlightThrottled_ = false;
+        return;
+    }
+    auto [index, id] = *pendingHighlight_;
+    pendingHighlight_.reset();
+    highlightThrottled_ = true;
+    // Its candidates are replaced while it waits.
+    if (id == windowCandidatesId_) {
+        post([=, this](InputContext *ic) { highlight(ic, index); });
+    }
+    constexpr int64_t frameInterval = NSEC_PER_SEC / 60;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, frameInterval),
+                   dispatch_get_main_queue(), ^{
+                     flushHighlight();
+                   });
+}
+
+void WebPanel::highlight(InputContext *ic, int index) {
+    const auto &list = ic->inputPanel().candidateList();
+    if (!list)
+        return;
+    if (scrollState_ != candidate_window::scroll_state_t::scrolling) {
+        return;
+    }
+    const auto bulkCursor = list->toBulkCursor();
+    if (!bulkCursor) {
+        return;
+    }
+    if (!candidateAt(list, index)) {
+        FCITX_ERROR() << "highlight candidate index out of range";
+        return;
+    }
+    int globalIndex = toGlobalIndex(index);
+    ++metrics_.deliveredHighlights;
+    bulkCursor->setGlobalCursorIndex(globalIndex);
+    // Candidate window can't move above its first row.
+    if (scrollOffset_ > 0 && index < *config_.scrollMode->maxColumnCount) {
+        scrollBack(ic, globalIndex);
+    }
+    maybePrefetch(globalIndex);
+}
+
+PanelCommand &WebPanel::command() {
+    // A pending or running render sends it with the frame.
+    if (!renderEvent_ && !rendering_ && !commandEvent_) {
+        commandEvent_ =
+            instance_->eventLoop().addDeferEvent([this](EventSource *) {
+                auto event = std::move(commandEvent_);
+                sendCommand();
+                return true;
+            });
+    }
+    return command_;
+}
+
+void WebPanel::sendCommand() {
+    commandEvent_.reset();
+    if (command_.empty()) {
+        return;
+    }
+    // Otherwise main thread hasn't run the last one, which now includes this.
+    if (mailbox_.post(std::exchange(command_, {}))) {
+        dispatch_async(dispatch_get_main_queue(), ^{
+          for (auto &command : mailbox_.take()) {
+              command.run();
+          }
+        });
+    }
+}
+
+void WebPanel::sendCandidates(std::shared_ptr<const CandidateFrame> frame) {
+    bool replace =
+        frame->scrollState != candidate_window::scroll_state_t::scrolling ||
+        frame->scrollStart;
+    command().addCandidates(
+        [this, frame, id = candidatesId_] {
+            window_->set_candidates(frame->candidates, frame->highlighted,
+                                    frame->scrollState, frame->scrollStart,
+                                    frame->scrollEnd);
+            windowCandidatesId_ = id;
+        },
+        replace);
+}
+
+void WebPanel::updateKeyTable() {
+    using candidate_window::scroll_key_action_t;
+    keyTable_.clear();
+    keyTable_.add(*config_.advanced->copyHtml, PanelKeyAction::CopyHtml);
+    keyTable_.add(*config_.scrollMode->expand, PanelKeyAction::Expand);
+
+    // Below are only checked when scrolling, in order of priority.
+    static const scroll_key_action_t selectActions[] = {
+        scroll_key_action_t::one,   scroll_key_action_t::two,
+        scroll_key_action_t::three, scroll_key_action_t::four,
+        scroll_key_action_t::five,  scroll_key_action_t::six,
+        scroll_key_action_t::seven, scroll_key_action_t::eight,
+        scroll_key_action_t::nine,  scroll_key_action_t::zero,
+    };
+    static const KeyList mainKeyboardNumberKeys = {
+        Key(FcitxKey_1), Key(FcitxKey_2), Key(FcitxKey_3), Key(FcitxKey_4),
+        Key(FcitxKey_5), Key(FcitxKey_6), Key(FcitxKey_7), Key(FcitxKey_8),
+        Key(FcitxKey_9), Key(FcitxKey_0)};
+    static const KeyList keypadNumberKeys = {
+        Key(FcitxKey_KP_1), Key(FcitxKey_KP_2), Key(FcitxKey_KP_3),
+        Key(FcitxKey_KP_4), Key(FcitxKey_KP_5), Key(FcitxKey_KP_6),
+        Key(FcitxKey_KP_7), Key(FcitxKey_KP_8), Key(FcitxKey_KP_9),
+        Key(FcitxKey_KP_0)};
+    auto addSelectKeys = [this](const KeyList &keys) {
+        for (size_t i = 0; i < std::min<size_t>(keys.size(), 10); ++i) {
+            keyTable_.add(keys[i], PanelKeyAction::Scroll, selectActions[i]);
+        }
+    };
+    addSelectKeys(*config_.scrollMode->selectCandidate);
+    if (*config_.scrollMode->useMainKeyboardNumberKeys) {
+        addSelectKeys(mainKeyboardNumberKeys);
+    }
+    if (*config_.scrollMode->useKeypadNumberKeys) {
+        addSelectKeys(keypadNumberKeys);
+    }
+
+    const std::pair<const KeyList &, scroll_key_action_t> navigationKeys[] = {
+        {*config_.scrollMode->up, scroll_key_action_t::up},
+        {*config_.scrollMode->down, scroll_key_action_t::down},
+        {*config_.scrollMode->left, scroll_key_action_t::left},
+        {*config_.scrollMode->right, scroll_key_action_t::right},
+        {*config_.scrollMode->rowStart, scroll_key_action_t::home},
+        {*config_.scrollMode->rowEnd, scroll_key_action_t::end},
+        {*config_.scrollMode->pageUp, scroll_key_action_t::page_up},
+        {*config_.scrollMode->pageDown, scroll_key_action_t::page_down},
+        {*config_.scrollMode->commit, scroll_key_action_t::commit},
+    };
+    for (const auto &[keys, action] : navigationKeys) {
+        // Must not send release event to engine, which resets scroll mode.
+        keyTable_.add(keys, PanelKeyAction::Scroll, action, true);
+    }
+    // Instead of directly calling collapse, let webview handle animation and
+    // call it.
+    keyTable_.add(*config_.scrollMode->collapse, PanelKeyAction::Scroll,
+                  scroll_key_action_t::collapse);
+
+    // Karabiner-Elements defines Hyper as Ctrl+Alt+Shift+Cmd, but its
+    // combinations cause fcitx5-rime to reset candidates. This is because
+    // librime's process_key returns 0 event if a key event (Shift) is handled,
+    // thus fcitx5-rime can't use the retval to decide update UI or not.
+    static const KeyList hyperModifiers = {
+        Key("Super+Super_L"),
+        Key("Control+Super+Control_L"),
+        Key("Control+Alt+Super+Alt_L"),
+        Key("Control+Alt+Shift+Super+Shift_L"),
+        Key("Alt+Shift+Super+Control_L"),
+        Key("Alt+Super+Shift_L"),
+        Key("Super+Alt_L"),
+        Key("Super_L"),
+        Key("Control+Control_L"),
+        Key("Control+Alt+Alt_L"),
+        Key("Control+Alt+Super+Super_L"),
+        Key("Alt+Super+Control_L"),
+    }; // keys received by Fcitx5 when CapsLock (Hyper) is pressed
+    if (*config_.scrollMode->optimizeForHyperKey) {
+        keyTable_.add(hyperModifiers, PanelKeyAction::Swallow, {}, true);
+    }
+}
+
 void WebPanel::updateConfig() {
-    setenv("BLUR", std::to_string(int(*config_.background->blur)).c_str(), 1);
-    dispatch_async(dispatch_get_main_queue(), ^{
-      window_->set_layout(config_.typography->layout.value());
-      window_->set_theme(config_.basic->theme.value());
-      window_->set_native_blur(*config_.background->blur);
-      // Keep CSS shadow as native may leave a ghost shadow of last frame when
-      // typing fast.
-      // window_->set_native_shadow(config_.background->shadow.value());
-      auto style = configValueToJson(config_).dump();
-      window_->set_style(style.c_str());
-      window_->unload_plugins();
-      using namespace candidate_window;
-      uint64_t apis = (config_.advanced->unsafeAPI->curl.value() ? kCurl : 0);
-      window_->set_api(apis);
-      if (*config_.advanced->pluginNotice) {
-          window_->load_plugins({*config_.advanced->plugins});
-      }
+    updateKeyTable();
+    auto config = configValueToJson(config_);
+    // Nothing to do for e.g. reloading an unchanged config.
+    if (config == appliedConfig_) {
+        return;
+    }
+    auto changed = [&](const char *path) {
+        nlohmann::json::json_pointer pointer(path);
+        return !appliedConfig_.contains(pointer) ||
+               appliedConfig_.at(pointer) != config.at(pointer);
+    };
+    bool layoutChanged = changed("/Typography/Layout");
+    bool themeChanged = changed("/Basic/Theme");
+    bool blurChanged = changed("/Background/Blur");
+    // Reloading plugins resets their state, so avoid it when only style
+    // changes, e.g. editing theme.
+    bool pluginsChanged = changed("/Advanced/PluginNotice") ||
+                          changed("/Advanced/Plugins") ||
+                          changed("/Advanced/UnsafeAPI");
+    appliedConfig_ = config;
+    // Style change needs everything to be rendered again.
+    forgetWindowState();
+    if (blurChanged) {
+        setenv("BLUR", std::to_string(int(*config_.background->blur)).c_str(),
+               1);
+    }
+    // The candidate window generates all CSS from a complete style, so style
+    // is sent as a whole.
+    auto style = config.dump();
+    bool styleChanged = style != sentStyle_;
+    if (styleChanged) {
+        sentStyle_ = style;
+        styleCache_.save(style);
+    }
+    auto layout = config_.typography->layout.value();
+    auto theme = config_.basic->theme.value();
+    auto blur = config_.background->blur.value();
+    using namespace candidate_window;
+    uint64_t apis = (config_.advanced->unsafeAPI->curl.value() ? kCurl : 0);
+    bool loadPlugins = *config_.advanced->pluginNotice;
+    auto plugins = *config_.advanced->plugins;
+    command().calls.push_back([=, this] {
+        if (layoutChanged) {
+            window_->set_layout(layout);
+        }
+        if (themeChanged) {
+            window_->set_theme(theme);
+        }
+        if (blurChanged) {
+            window_->set_native_blur(blur);
+        }
+        // Keep CSS shadow as native may leave a ghost shadow of last frame
+        // when typing fast.
+        // window_->set_native_shadow(config_.background->shadow.value());
+        if (styleChanged) {
+            window_->set_style(style.c_str());
+        }
+        if (pluginsChanged) {
+            window_->unload_plugins();
+            window_->set_api(apis);
+            if (loadPlugins) {
+                window_->load_plugins(plugins);
+            }
+        }
     });
 }
 
@@ -352,131 +495,262 @@ void WebPanel::update(UserInterfaceComponent component,
                       InputContext *inputContext) {
     switch (component) {
     case UserInterfaceComponent::InputPanel: {
-        int highlighted = -1;
+        // Client preedit and dummy preedit must be settled before a sync event
+        // returns, but rendering the panel can wait for other updates of the
+        // same event loop iteration, e.g. engine updating preedit, candidates
+        // and aux separately.
         const InputPanel &inputPanel = inputContext->inputPanel();
-        updateInputPanel(
-            instance_->outputFilter(inputContext, inputPanel.preedit()),
-            instance_->outputFilter(inputContext, inputPanel.auxUp()),
-            instance_->outputFilter(inputContext, inputPanel.auxDown()));
-        bool pageable = false;
-        bool hasPrev = false;
-        bool hasNext = false;
-        std::vector<candidate_window::Candidate> candidates;
-        int size = 0;
-        candidate_window::layout_t layout = config_.typography->layout.value();
-        candidate_window::writing_mode_t writingMode =
-            config_.typography->writingMode.value();
-        if (const auto &list = inputPanel.candidateList()) {
-            switch (list->layoutHint()) {
-            case CandidateLayoutHint::Vertical:
-                layout = candidate_window::layout_t::vertical;
-                break;
-            case CandidateLayoutHint::Horizontal:
-                layout = candidate_window::layout_t::horizontal;
-                break;
-            default:
-                break;
-            }
-            // hack for rime
-            if (*config_.typography->typographyAwarenessForIM) {
-                // Allow -> to move highlight on horizontal+horizontal_tb.
-                f5m_is_linear_layout =
-                    (layout == candidate_window::layout_t::horizontal);
-                f5m_is_vertical_rl =
-                    (writingMode ==
-                     candidate_window::writing_mode_t::vertical_rl);
-                f5m_is_vertical_lr =
-                    (writingMode ==
-                     candidate_window::writing_mode_t::vertical_lr);
-            } else {
-                // Allow -> to move highlight on horizontal+horizontal_tb.
-                f5m_is_linear_layout = false;
-                f5m_is_vertical_rl = false;
-                f5m_is_vertical_lr = false;
+        const auto &list = inputPanel.candidateList();
+        updatePanelShowFlags(!inputPanel.preedit().empty(),
+                             PanelShowFlag::HasPreedit);
+        updatePanelShowFlags(!inputPanel.auxUp().empty(),
+                             PanelShowFlag::HasAuxUp);
+        updatePanelShowFlags(!inputPanel.auxDown().empty(),
+                             PanelShowFlag::HasAuxDown);
+        updatePanelShowFlags(list && !list->empty(),
+                             PanelShowFlag::HasCandidates);
+        // Scheduled first so that client update is sent with the frame.
+        scheduleRender(inputContext);
+        updateClient(inputContext);
+        break;
+    }
+    case UserInterfaceComponent::StatusArea:
+        // No need to implement.  MacOS will always try to fetch new
+        // data, and we don't try to cache anything.
+        // But a changed action may be a filter toggle.
+        invalidateFilterState();
+        break;
+    }
+}
+
+void WebPanel::scheduleRender(InputContext *inputContext) {
+    renderIC_ = inputContext->watch();
+    if (renderEvent_) {
+        ++metrics_.skippedRenders;
+        return;
+    }
+    renderEvent_ = instance_->eventLoop().addDeferEvent([this](EventSource *) {
+        // Keep the callback alive, while allowing render to schedule again.
+        auto event = std::move(renderEvent_);
+        ++metrics_.renders;
+        if (keyFrame_) {
+            keyFrame_->rendered = std::chrono::steady_clock::now();
+        }
+        rendering_ = true;
+        if (auto *ic = renderIC_.get()) {
+            render(ic);
+        } else {
+            delayHide_ = false;
+            showAsync(false);
+        }
+        rendering_ = false;
+        sendCommand();
+        // The key didn't show candidate window.
+        keyFrame_.reset();
+        return true;
+    });
+}
+
+void WebPanel::render(InputContext *inputContext) {
+    if (!panelShow_ && hideDelayed()) {
+        // Keep content in case the panel comes back right after commit, but
+        // drop callbacks on it and send the next frame in full.
+        scrollState_ = candidate_window::scroll_state_t::none;
+        lastFrame_.reset();
+        ++candidatesId_;
+        return hideAsync();
+    }
+    int highlighted = -1;
+    const InputPanel &inputPanel = inputContext->inputPanel();
+    if (scrollList_.lock() != inputPanel.candidateList()) {
+        resetPrefetch();
+    }
+    // e.g. moving highlight doesn't change preedit and aux, and a status
+    // message only changes aux.
+    if (inputPanelChanged(inputContext)) {
+        updateInputPanel(outputFilter(inputContext, inputPanel.preedit()),
+                         outputFilter(inputContext, inputPanel.auxUp()),
+                         outputFilter(inputContext, inputPanel.auxDown()));
+    } else {
+        ++metrics_.skippedWindowCalls;
+    }
+    bool pageable = false;
+    bool hasPrev = false;
+    bool hasNext = false;
+    CandidateFrame frame;
+    std::function<std::vector<candidate_window::CandidateAction>(size_t)>
+        actionsOf;
+    int size = 0;
+    candidate_window::layout_t layout = config_.typography->layout.value();
+    candidate_window::writing_mode_t writingMode =
+        config_.typography->writingMode.value();
+    if (const auto &list = inputPanel.candidateList()) {
+        switch (list->layoutHint()) {
+        case CandidateLayoutHint::Vertical:
+            layout = candidate_window::layout_t::vertical;
+            break;
+        case CandidateLayoutHint::Horizontal:
+            layout = candidate_window::layout_t::horizontal;
+            break;
+        default:
+            break;
+        }
+        // hack for rime
+        if (*config_.typography->typographyAwarenessForIM) {
+            // Allow -> to move highlight on horizontal+horizontal_tb.
+            f5m_is_linear_layout =
+                (layout == candidate_window::layout_t::horizontal);
+            f5m_is_vertical_rl =
+                (writingMode == candidate_window::writing_mode_t::vertical_rl);
+            f5m_is_vertical_lr =
+                (writingMode == candidate_window::writing_mode_t::vertical_lr);
+        } else {
+            // Allow -> to move highlight on horizontal+horizontal_tb.
+            f5m_is_linear_layout = false;
+            f5m_is_vertical_rl = false;
+            f5m_is_vertical_lr = false;
+        }
+        // Paging
+        auto *pageableList = list->toPageable();
+        if (pageableList) {
+            pageable = *config_.typography->pagingButtonsStyle !=
+                       PagingButtonsStyle::None;
+            hasPrev = pageableList->hasPrev();
+            hasNext = pageableList->hasNext();
+        }
+        // Scroll mode
+        const auto &bulk = list->toBulk();
+        if (layout == candidate_window::layout_t::horizontal &&
+            writingMode == candidate_window::writing_mode_t::horizontal_tb &&
+            *config_.scrollMode->enableScroll && bulk) {
+            if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
+                renderScroll(inputContext, 0, expandCount());
+                return;
             }
-            // Paging
-            auto *pageableList = list->toPageable();
-            if (pageableList) {
-                pageable = *config_.typography->pagingButtonsStyle !=
-                           PagingButtonsStyle::None;
-                hasPrev = pageableList->hasPrev();
-                hasNext = pageableList->hasNext();
+            if (*config_.scrollMode->autoExpand) {
+                scrollState_ = candidate_window::scroll_state_t::scrolling;
+                renderScroll(inputContext, 0, expandCount());
+                return;
             }
-            // Scroll mode
-            const auto &bulk = list->toBulk();
-            if (layout == candidate_window::layout_t::horizontal &&
-                writingMode ==
-                    candidate_window::writing_mode_t::horizontal_tb &&
-                *config_.scrollMode->enableScroll && bulk) {
-                if (scrollState_ ==
-                    candidate_window::scroll_state_t::scrolling) {
-                    return expand();
-                }
-                if (*config_.scrollMode->autoExpand) {
-                    scrollState_ = candidate_window::scroll_state_t::scrolling;
-                    return expand();
-                }
-                // Disable scroll mode if all candidates are on the same page.
-                if (hasPrev || hasNext) {
-                    scrollState_ = candidate_window::scroll_state_t::ready;
-                } else {
-                    pageable = false;
-                    scrollState_ = candidate_window::scroll_state_t::none;
-                }
+            // Disable scroll mode if all candidates are on the same page.
+            if (hasPrev || hasNext) {
+                scrollState_ = candidate_window::scroll_state_t::ready;
             } else {
+                pageable = false;
                 scrollState_ = candidate_window::scroll_state_t::none;
             }
-            // Candidate actions
-            auto *actionableList = list->toActionable();
-            size = list->size();
-            for (int i = 0; i < size; i++) {
-                auto label = list->label(i).toString();
-                // HACK: fcitx5's Linux UI concatenates label and text and
-                // expects engine to append a ' ' to label.
-                auto length = label.length();
-                if (length && label[length - 1] == ' ') {
-                    label = label.substr(0, length - 1);
-                }
-                const auto &candidate = list->candidate(i);
-                std::vector<candidate_window::CandidateAction> actions;
-                if (actionableList && actionableList->hasAction(candidate)) {
-                    for (const auto &action :
-                         actionableList->candidateActions(candidate)) {
-                        actions.push_back({action.id(), action.text()});
-                    }
-                }
-                candidates.push_back(
-                    {instance_->outputFilter(inputContext, candidate.text())
-                         .toString(),
-                     label,
-                     instance_->outputFilter(inputContext, candidate.comment())
-                         .toString(),
-                     actions});
-            }
-            highlighted = list->cursorIndex();
         } else {
             scrollState_ = candidate_window::scroll_state_t::none;
         }
-        window_->set_paging_buttons(pageable, hasPrev, hasNext);
-        window_->set_layout(layout);
-        window_->set_writing_mode(writingMode);
-        bool candidatesEmpty = candidates.empty();
-        // Must be called after set_layout and set_writing_mode so that proper
-        // states are read after set.
-        window_->set_candidates(std::move(candidates), highlighted,
-                                scrollState_, false, false);
-        updatePanelShowFlags(!candidatesEmpty, PanelShowFlag::HasCandidates);
-        updateClient(inputContext);
-        showAsync(panelShow_);
-        break;
+        // Candidate actions are only enumerated in setCandidates for frames
+        // that need to be sent.
+        auto *actionableList = list->toActionable();
+        if (actionableList) {
+            actionsOf = [list, actionableList](size_t i) {
+                return candidateActions(actionableList, list->candidate(i));
+            };
+        }
+        size = list->size();
+        // Text and comment of each candidate, to be filtered together.
+        std::vector<Text> texts;
+        for (int i = 0; i < size; i++) {
+            const auto &candidate = list->candidate(i);
+            texts.push_back(candidate.text());
+            texts.push_back(candidate.comment());
+            if (actionableList) {
+                frame.hasActions.push_back(
+                    actionableList->hasAction(candidate));
+            }
+        }
+        auto filtered = outputFilter(inputContext, texts);
+        frame.candidates.reserve(size);
+        for (int i = 0; i < size; i++) {
+            auto label = list->label(i).toString();
+            // HACK: fcitx5's Linux UI concatenates label and text and
+            // expects engine to append a ' ' to label.
+            if (label.ends_with(' ')) {
+                label.pop_back();
+            }
+            frame.candidates.push_back({filtered[2 * i].toString(),
+                                        std::move(label),
+                                        filtered[2 * i + 1].toString(),
+                                        {}});
+        }
+        highlighted = list->cursorIndex();
+    } else {
+        scrollState_ = candidate_window::scroll_state_t::none;
     }
-    case UserInterfaceComponent::StatusArea:
-        // No need to implement.  MacOS will always try to fetch new
-        // data, and we don't try to cache anything.
-        break;
+    setLayout(pageable, hasPrev, hasNext, layout, writingMode);
+    bool candidatesEmpty = frame.candidates.empty();
+    frame.highlighted = highlighted;
+    frame.scrollState = scrollState_;
+    frame.layout = layout;
+    frame.writingMode = writingMode;
+    // Must be called after set_layout and set_writing_mode so that proper
+    // states are read after set.
+    setCandidates(std::move(frame), actionsOf);
+    updatePanelShowFlags(!candidatesEmpty, PanelShowFlag::HasCandidates);
+    showAsync(panelShow_);
+}
+
+bool WebPanel::inputPanelChanged(InputContext *ic) {
+    // Preedit of password is masked according to its address.
+    if (ic->capabilityFlags().test(CapabilityFlag::Password)) {
+        inputPanelKey_.clear();
+        return true;
+    }
+    const InputPanel &inputPanel = ic->inputPanel();
+    updateFilterState(ic);
+    std::string key;
+    for (const auto *text :
+         {&inputPanel.preedit(), &inputPanel.auxUp(), &inputPanel.auxDown()}) {
+        appendTextKey(key, *text);
+    }
+    if (key == inputPanelKey_ && filterState_ == inputPanelState_) {
+        return false;
+    }
+    inputPanelKey_ = std::move(key);
+    inputPanelState_ = filterState_;
+    return true;
+}
+
+void WebPanel::setLayout(bool pageable, bool hasPrev, bool hasNext,
+                         candidate_window::layout_t layout,
+                         candidate_window::writing_mode_t writingMode) {
+    auto &command = this->command();
+    std::tuple pagingButtons{pageable, hasPrev, hasNext};
+    if (sentPagingButtons_ != pagingButtons) {
+        sentPagingButtons_ = pagingButtons;
+        command.pagingButtons = [this, pageable, hasPrev, hasNext] {
+            window_->set_paging_buttons(pageable, hasPrev, hasNext);
+        };
+    } else {
+        ++metrics_.skippedWindowCalls;
+    }
+    if (sentLayout_ != layout) {
+        sentLayout_ = layout;
+        command.layout = [this, layout] { window_->set_layout(layout); };
+    } else {
+        ++metrics_.skippedWindowCalls;
+    }
+    if (sentWritingMode_ != writingMode) {
+        sentWritingMode_ = writingMode;
+        command.writingMode = [this, writingMode] {
+            window_->set_writing_mode(writingMode);
+        };
+    } else {
+        ++metrics_.skippedWindowCalls;
     }
 }
 
+void WebPanel::forgetWindowState() {
+    lastFrame_.reset();
+    inputPanelKey_.clear();
+    sentPagingButtons_.reset();
+    sentLayout_.reset();
+    sentWritingMode_.reset();
+}
+
 void WebPanel::updateInputPanel(const Text &preedit, const Text &auxUp,
                                 const Text &auxDown) {
     auto convert = [](const Text &text) {
@@ -487,8 +761,11 @@ void WebPanel::updateInputPanel(const Text &preedit, const Text &auxUp,
         }
         return ret;
     };
-    window_->update_input_panel(convert(preedit), preedit.cursor(),
-                                convert(auxUp), convert(auxDown));
+    command().inputPanel = [this, preedit = convert(preedit),
+                            cursor = preedit.cursor(), auxUp = convert(auxUp),
+                            auxDown = convert(auxDown)] {
+        window_->update_input_panel(preedit, cursor, auxUp, auxDown);
+    };
     updatePanelShowFlags(!preedit.empty(), PanelShowFlag::HasPreedit);
     updatePanelShowFlags(!auxUp.empty(), PanelShowFlag::HasAuxUp);
     updatePanelShowFlags(!auxDown.empty(), PanelShowFlag::HasAuxDown);
@@ -501,27 +778,136 @@ void WebPanel::updateClient(InputContext *ic) {
         macosIC->setDummyPreedit(bool(panelShow_) &&
                                  !macosIC->inputPanel().transient());
         if (!macosIC->isSyncEvent) {
-            macosIC->commitAndSetPreeditAsync();
+            auto state = macosIC->takeAsyncState();
+            auto &command = this->command();
+            command.commit += state.commit;
+            command.client = [state](const std::string &commit) mutable {
+                state.commit = commit;
+                MacosInputContext::commitAndSetPreedit(state);
+            };
+        }
+    }
+}
+
+void WebPanel::setCandidates(
+    CandidateFrame frame,
+    const std::function<std::vector<candidate_window::CandidateAction>(
+        size_t)> &actionsOf) {
+    auto change = lastFrame_ ? diffCandidateFrames(*lastFrame_, frame)
+                             : FrameChange::Changed;
+    if (change == FrameChange::None) {
+        return;
+    }
+    if (change != FrameChange::CursorOnly) {
+        ++candidatesId_;
+    }
+    for (size_t i = 0; i < frame.hasActions.size(); ++i) {
+        if (!frame.hasActions[i]) {
+            continue;
+        }
+        if (change == FrameChange::CursorOnly) {
+            // Same candidates, reuse what was enumerated.
+            frame.candidates[i].actions = lastFrame_->candidates[i].actions;
+        } else if (actionsOf) {
+            frame.candidates[i].actions = actionsOf(i);
         }
     }
+    // set_candidates has no partial update, so any change sends and
+    // re-renders all candidates. Only unchanged frames (e.g. engine updating
+    // UI for a non-candidate key) are skipped.
+    // Shared with the command instead of copied.
+    lastFrame_ = std::make_shared<const CandidateFrame>(std::move(frame));
+    sendCandidates(lastFrame_);
 }
 
 /// Before calling this, the panel states must already be initialized
 /// synchronously, by using set_candidates, etc.
 void WebPanel::showAsync(bool show) {
+    if (!show) {
+        return hideAsync();
+    }
+    if (hideEvent_) {
+        hideEvent_.reset();
+        ++metrics_.avoidedHides;
+    }
+    delayHide_ = false;
+    shown_ = true;
     bool followCaret = *config_.basic->followCaret;
-    dispatch_async(dispatch_get_main_queue(), ^void() {
-      if (show) {
-          // MacosInputContext::updatePreeditImpl is executed before
-          // WebPanel::update, so in main thread preedit UI update
-          // happens before here.
-          auto [x, y, height] =
-              MacosInputContext::getCaretCoordinates(followCaret);
-          window_->show(x, y, height);
-      } else {
-          window_->hide();
-      }
-    });
+    std::shared_ptr<CaretCache> caretCache;
+    CaretCache::Version version;
+    if (auto ic = dynamic_cast<MacosInputContext *>(
+            instance_->mostRecentInputContext())) {
+        caretCache = ic->caretCache();
+        version = caretCache->version();
+    }
+    auto keyFrame = std::exchange(keyFrame_, std::nullopt);
+    if (keyFrame && keyFrame->rendered == KeyFrame::Clock::time_point{}) {
+        // Shown in key event, e.g. expanding.
+        keyFrame->rendered = KeyFrame::Clock::now();
+    }
+    command().visibility = [this, followCaret, caretCache, version,
+                            keyFrame] {
+        // Client preedit of the frame is set before this, so that caret is
+        // where it's composed.
+        auto [x, y, height] = MacosInputContext::getCaretCoordinates(
+            followCaret, caretCache.get(), version);
+        window_->show(x, y, height);
+        if (keyFrame) {
+            recordKeyFrame(*keyFrame);
+        }
+    };
+}
+
+void WebPanel::keyReceived(KeyFrame::Clock::time_point time) {
+    keyFrame_ = KeyFrame{++frameSeq_, time, {}};
+}
+
+void WebPanel::keyProcessed() {
+    // Otherwise the frame is rendered later in this event loop iteration.
+    if (!renderEvent_) {
+        keyFrame_.reset();
+    }
+}
+
+/// Called in main thread when the frame of a key is shown. A frame merged
+/// into a newer one is not shown, and its key is not sampled.
+void WebPanel::recordKeyFrame(const KeyFrame &frame) {
+    auto shown = KeyFrame::Clock::now();
+    auto us = [](KeyFrame::Clock::duration duration) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(duration)
+            .count();
+    };
+    std::lock_guard lock(keyLatency_.mutex);
+    keyLatency_.total.add(us(shown - frame.received));
+    keyLatency_.engine.add(us(frame.rendered - frame.received));
+    keyLatency_.ui.add(us(shown - frame.rendered));
+    keyLatency_.shownSeq = frame.seq;
+}
+
+bool WebPanel::hideDelayed() const {
+    return shown_ && delayHide_ && *config_.advanced->hideDelay > 0;
+}
+
+void WebPanel::hideAsync() {
+    if (hideDelayed()) {
+        if (!hideEvent_) {
+            ++metrics_.delayedHides;
+            hideEvent_ = instance_->eventLoop().addTimeEvent(
+                CLOCK_MONOTONIC,
+                now(CLOCK_MONOTONIC) + *config_.advanced->hideDelay * 1000,
+                1000, [this](EventSourceTime *, uint64_t) {
+                    auto event = std::move(hideEvent_);
+                    delayHide_ = false;
+                    hideAsync();
+                    return true;
+                });
+        }
+        return;
+    }
+    hideEvent_.reset();
+    delayHide_ = false;
+    shown_ = false;
+    command().visibility = [this] { window_->hide(); };
 }
 
 void WebPanel::scroll(int start, int count) {
@@ -532,6 +918,107 @@ void WebPanel::scroll(int start, int count) {
         return collapse();
     }
     auto ic = instance_->mostRecentInputContext();
+    if (renderScroll(ic, start, count)) {
+        updateClient(ic);
+    }
+}
+
+bool WebPanel::renderScroll(InputContext *ic, int start, int count) {
+    const auto &list = ic->inputPanel().candidateList();
+    if (!list) {
+        return false;
+    }
+    const auto &bulk = list->toBulk();
+    if (!bulk) {
+        return false;
+    }
+    if (scrollList_.lock() != list) {
+        resetPrefetch();
+        scrollList_ = list;
+    }
+    CandidateFrame frame;
+    auto &candidates = frame.candidates;
+    bool endReached;
+    if (prefetched_ && prefetched_->start == start) {
+        auto &chunk = *prefetched_;
+        int prefetchedSize = chunk.candidates.size();
+        int n = std::min(count, prefetchedSize);
+        auto begin = chunk.candidates.begin();
+        candidates.assign(std::make_move_iterator(begin),
+                          std::make_move_iterator(begin + n));
+        if (n < prefetchedSize) {
+            chunk.candidates.erase(begin, begin + n);
+            chunk.start += n;
+            endReached = false;
+        } else {
+            bool chunkEndReached = chunk.endReached;
+            prefetched_.reset();
+            if (chunkEndReached) {
+                endReached = true;
+            } else if (n < count) {
+                endReached = fetchCandidates(ic, list, start + n, count - n,
+                                             candidates);
+            } else {
+                endReached = bulkEnd(list) == start + count;
+            }
+        }
+    } else {
+        // Keep prefetched chunk if it follows this one, e.g. on expanding
+        // again after highlight changes.
+        if (prefetched_ && prefetched_->start != start + count) {
+            prefetched_.reset();
+        }
+        endReached = fetchCandidates(ic, list, start, count, candidates);
+    }
+    scrollLoadedEnd_ = start + candidates.size();
+    scrollEndReached_ = endReached;
+    scrollChunkSize_ = count;
+    scrollState_ = candidate_window::scroll_state_t::scrolling;
+    frame.scrollState = scrollState_;
+    frame.scrollEnd = endReached;
+    if (start == 0) {
+        scrollOffset_ = 0;
+        frame.scrollStart = true;
+        setCandidates(std::move(frame));
+    } else if (scrollLoadedEnd_ - scrollOffset_ >
+               *config_.scrollMode->residentCandidates) {
+        // Evict rows behind, but keep the previous chunk visible.
+        scrollOffset_ = std::max(0, start - count);
+        std::vector<candidate_window::Candidate> rows;
+        fetchCandidates(ic, list, scrollOffset_, start - scrollOffset_, rows);
+        rows.insert(rows.end(), std::make_move_iterator(candidates.begin()),
+                    std::make_move_iterator(candidates.end()));
+        candidates = std::move(rows);
+        lastFrame_.reset();
+        ++candidatesId_;
+        // Keep highlight on the same candidate, which is now at a different
+        // index.
+        if (const auto bulkCursor = list->toBulkCursor()) {
+            int cursor = bulkCursor->globalCursorIndex() - scrollOffset_;
+            if (cursor >= 0 && cursor < static_cast<int>(candidates.size())) {
+                frame.highlighted = cursor;
+            }
+        }
+        // Replace rather than append.
+        frame.scrollStart = true;
+        sendCandidates(
+            std::make_shared<const CandidateFrame>(std::move(frame)));
+    } else {
+        // Appended chunks are not tracked, so the next frame can't be diffed.
+        lastFrame_.reset();
+        sendCandidates(
+            std::make_shared<const CandidateFrame>(std::move(frame)));
+    }
+    showAsync(true);
+    // Candidate window asks for the next chunk when user reaches the end, so
+    // user is around start now.
+    maybePrefetch(start);
+    return true;
+}
+
+/// Candidate window only asks for rows after its last one, so rows before it
+/// are sent again, centered around index, when user moves back to its top.
+void WebPanel::scrollBack(InputContext *ic, int index) {
     const auto &list = ic->inputPanel().candidateList();
     if (!list) {
         return;
@@ -540,36 +1027,181 @@ void WebPanel::scroll(int start, int count) {
     if (!bulk) {
         return;
     }
-    int size = bulk->totalSize();
-    int end = size < 0 ? start + count : std::min(start + count, size);
-    bool endReached = size == end;
-    std::vector<candidate_window::Candidate> candidates;
-    for (int i = start; i < end; ++i) {
-        try {
-            auto &candidate = bulk->candidateFromAll(i);
-            candidates.push_back(
-                {instance_->outputFilter(ic, candidate.text()).toString(),
-                 "",
-                 instance_->outputFilter(ic, candidate.comment()).toString(),
-                 {}});
-        } catch (const std::invalid_argument &e) {
-            // size == -1 but actual limit is reached
-            endReached = true;
+    int resident = *config_.scrollMode->residentCandidates;
+    int offset = std::max(0, index - resident / 2);
+    // Replacing rows would move those under pointer, e.g. when hovering the
+    // first row again.
+    if (offset == scrollOffset_) {
+        return;
+    }
+    CandidateFrame frame;
+    bool endReached =
+        fetchCandidates(ic, list, offset,
+                        std::min(resident, scrollLoadedEnd_ - offset),
+                        frame.candidates);
+    scrollOffset_ = offset;
+    scrollLoadedEnd_ = offset + frame.candidates.size();
+    scrollEndReached_ = endReached;
+    // It doesn't follow the new loaded end anymore.
+    prefetched_.reset();
+    lastFrame_.reset();
+    ++candidatesId_;
+    frame.highlighted = index - offset;
+    frame.scrollState = scrollState_;
+    frame.scrollStart = true;
+    frame.scrollEnd = endReached;
+    sendCandidates(std::make_shared<const CandidateFrame>(std::move(frame)));
+}
+
+int WebPanel::toGlobalIndex(int index) const {
+    if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
+        return scrollOffset_ + index;
+    }
+    return index;
+}
+
+/// Append filtered candidates [start, start + count) of list, and return
+/// whether the end of list is reached.
+bool WebPanel::fetchCandidates(InputContext *ic,
+                               const std::shared_ptr<CandidateList> &list,
+                               int start, int count,
+                               std::vector<candidate_window::Candidate>
+                                   &candidates) {
+    std::vector<const CandidateWord *> words;
+    int n = fetchRange(list, start, count, words);
+    std::vector<Text> texts;
+    for (const auto *word : words) {
+        texts.push_back(word->text());
+        texts.push_back(word->comment());
+    }
+    auto filtered = outputFilter(ic, texts);
+    for (size_t i = 0; i < filtered.size(); i += 2) {
+        candidates.push_back(
+            {filtered[i].toString(), "", filtered[i + 1].toString(), {}});
+    }
+    int end = bulkEnd(list);
+    return end >= 0 && start + n >= end;
+}
+
+/// Collect candidates [start, start + count) of a bulk list, and return how
+/// many are available.
+int WebPanel::fetchRange(const std::shared_ptr<CandidateList> &list,
+                         int start, int count,
+                         std::vector<const CandidateWord *> &words) {
+    if (int end = bulkEnd(list); end >= 0) {
+        count = std::clamp(end - start, 0, count);
+    }
+    int n = 0;
+    for (; n < count; ++n) {
+        auto *candidate = candidateFromAll(list, start + n);
+        if (!candidate) {
             break;
         }
+        words.push_back(candidate);
     }
-    scrollState_ = candidate_window::scroll_state_t::scrolling;
-    window_->set_candidates(std::move(candidates), -1, scrollState_, start == 0,
-                            endReached);
-    updateClient(ic);
-    showAsync(true);
+    return n;
+}
+
+int WebPanel::bulkEnd(const std::shared_ptr<CandidateList> &list) const {
+    if (auto *bulk = list->toBulk(); bulk && bulk->totalSize() >= 0) {
+        return bulk->totalSize();
+    }
+    return knownEndList_.lock() == list ? knownEnd_ : -1;
+}
+
+/// Like BulkCandidateList::candidateFromAll, but null if index is out of
+/// range.
+const CandidateWord *
+WebPanel::candidateFromAll(const std::shared_ptr<CandidateList> &list,
+                           int index) {
+    auto *bulk = list->toBulk();
+    if (!bulk || index < 0) {
+        return nullptr;
+    }
+    int end = bulkEnd(list);
+    if (end >= 0 && index >= end) {
+        return nullptr;
+    }
+    // An engine may throw before the end it reports, which must not reach
+    // the event loop.
+    try {
+        return &bulk->candidateFromAll(index);
+    } catch (const std::invalid_argument &e) {
+        // Size is unknown, so the end can only be found by hitting it, after
+        // which it's known and not probed again.
+        if (end < 0) {
+            knownEndList_ = list;
+            knownEnd_ = index;
+        }
+        return nullptr;
+    }
+}
+
+/// Candidate of index of candidate window, or null if it's out of range.
+const CandidateWord *
+WebPanel::candidateAt(const std::shared_ptr<CandidateList> &list,
+                      int index) {
+    if (scrollState_ == candidate_window::scroll_state_t::scrolling) {
+        return candidateFromAll(list, toGlobalIndex(index));
+    }
+    if (index < 0 || index >= list->size()) {
+        return nullptr;
+    }
+    return &list->candidate(index);
+}
+
+void WebPanel::maybePrefetch(int index) {
+    int distance = *config_.scrollMode->prefetchDistance;
+    if (!distance ||
+        scrollState_ != candidate_window::scroll_state_t::scrolling ||
+        scrollEndReached_ || prefetched_ || prefetchEvent_ ||
+        index + distance < scrollLoadedEnd_) {
+        return;
+    }
+    prefetchEvent_ =
+        instance_->eventLoop().addDeferEvent([this](EventSource *) {
+            prefetch();
+            prefetchEvent_.reset();
+            return true;
+        });
+}
+
+void WebPanel::prefetch() {
+    if (scrollState_ != candidate_window::scroll_state_t::scrolling) {
+        return;
+    }
+    auto ic = instance_->mostRecentInputContext();
+    if (!ic) {
+        return;
+    }
+    const auto &list = ic->inputPanel().candidateList();
+    // Candidates of a different list are useless.
+    if (!list || scrollList_.lock() != list) {
+        return;
+    }
+    const auto &bulk = list->toBulk();
+    if (!bulk) {
+        return;
+    }
+    PrefetchedChunk chunk{scrollLoadedEnd_};
+    chunk.endReached = fetchCandidates(ic, list, chunk.start, scrollChunkSize_,
+                                       chunk.candidates);
+    prefetched_ = std::move(chunk);
+}
+
+void WebPanel::resetPrefetch() {
+    scrollList_.reset();
+    prefetched_.reset();
+    prefetchEvent_.reset();
 }
 
-void WebPanel::expand() {
-    scroll(0, *config_.scrollMode->maxColumnCount *
-                  (*config_.scrollMode->maxRowCount + 1));
+int WebPanel::expandCount() const {
+    return *config_.scrollMode->maxColumnCount *
+           (*config_.scrollMode->maxRowCount + 1);
 }
 
+void WebPanel::expand() { scroll(0, expandCount()); }
+
 void WebPanel::collapse() {
     auto ic = instance_->mostRecentInputContext();
     // Can't let update to set scrollState_, because it will keep scrollState_
@@ -578,10 +1210,70 @@ void WebPanel::collapse() {
     update(UserInterfaceComponent::InputPanel, ic);
 }
 
+nlohmann::json WebPanel::metrics() const {
+    return {{"renders", metrics_.renders},
+            {"skippedRenders", metrics_.skippedRenders},
+            {"delayedHides", metrics_.delayedHides},
+            {"avoidedHides", metrics_.avoidedHides},
+            {"staleCallbacks", metrics_.staleCallbacks},
+            {"generatedHighlights", metrics_.generatedHighlights.load()},
+            {"deliveredHighlights", metrics_.deliveredHighlights},
+            {"mergedFrames", mailbox_.merged()},
+            {"skippedWindowCalls", metrics_.skippedWindowCalls},
+            {"filterCacheHits", filterCache_.hits()},
+            {"filterCacheMisses", filterCache_.misses()},
+            {"caretCacheHits", CaretCache::hits.load()},
+            {"caretCacheMisses", CaretCache::misses.load()},
+            {"keyToPanel", keyLatencyJson()}};
+}
+
+nlohmann::json WebPanel::keyLatencyJson() const {
+    std::lock_guard lock(keyLatency_.mutex);
+    return {{"keys", frameSeq_},
+            {"lastShownKey", keyLatency_.shownSeq},
+            {"total", keyLatency_.total.toJson()},
+            {"engine", keyLatency_.engine.toJson()},
+            {"ui", keyLatency_.ui.toJson()}};
+}
+
+void WebPanel::updateFilterState(InputContext *ic) {
+    if (filterStateIC_.get() != ic) {
+        filterState_ = filterCache_.intern(filterStateKey(
+            instance_->inputMethod(ic), ic->statusArea().allActions(), ic));
+        filterStateIC_ = ic->watch();
+    }
+}
+
+Text WebPanel::outputFilter(InputContext *ic, const Text &text) {
+    // Preedit of password is masked according to its address, which can't be
+    // cached.
+    if (ic->capabilityFlags().test(CapabilityFlag::Password)) {
+        return instance_->outputFilter(ic, text);
+    }
+    updateFilterState(ic);
+    return filterCache_.filter(filterState_, text, [&](const Text &orig) {
+        return instance_->outputFilter(ic, orig);
+    });
+}
+
+std::vector<Text> WebPanel::outputFilter(InputContext *ic,
+                                         const std::vector<Text> &texts) {
+    std::vector<Text> results(texts.size());
+    updateFilterState(ic);
+    for (size_t i = 0; i < texts.size(); ++i) {
+        if (const auto *value = filterCache_.find(filterState_, texts[i])) {
+            results[i] = *value;
+        } else {
+            results[i] = instance_->outputFilter(ic, texts[i]);
+            filterCache_.insert(filterState_, texts[i], results[i]);
+        }
+    }
+    return results;
+}
+
 void WebPanel::applyAppAccentColor(const std::string &accentColor) {
-    auto captured = accentColor;
-    dispatch_async(dispatch_get_main_queue(), ^{
-      window_->apply_app_accent_color(captured);
+    command().calls.push_back([this, accentColor] {
+        window_->apply_app_accent_color(accentColor);
     });
 }
 
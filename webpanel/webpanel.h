@@ -1,15 +1,32 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
 #include <fcitx-config/configuration.h>
 #include <fcitx-config/enum.h>
 #include <fcitx-config/iniparser.h>
+#include <fcitx-utils/event.h>
 #include <fcitx-utils/i18n.h>
+#include <fcitx-utils/standardpaths.h>
 #include <fcitx/addonfactory.h>
 #include <fcitx/addoninstance.h>
 #include <fcitx/addonmanager.h>
 #include <fcitx/instance.h>
+#include <nlohmann/json.hpp>
 
-#include "webview_candidate_window.hpp"
+#include "../macosfrontend/latency.h"
+#include "candidateframe.h"
+#include "filtercache.h"
+#include "keytable.h"
+#include "panelcommand.h"
+#include "panelwindow.h"
+#include "stylecache.h"
 
 #define BORDER_WIDTH_MAX 10
 
@@ -215,6 +232,16 @@ FCITX_CONFIGURATION(
         this, "MaxRowCount", _("Max row count"), 6, IntConstrain(2, 10)};
     Option<int, IntConstrain> maxColumnCount{
         this, "MaxColumnCount", _("Max column count"), 6, IntConstrain(2, 10)};
+    Option<int, IntConstrain> prefetchDistance{
+        this, "PrefetchDistance",
+        _("Prefetch next candidates within this distance (0 to disable)"), 30,
+        IntConstrain(0, 200)};
+    Option<int, IntConstrain> residentCandidates{
+        this, "ResidentCandidates",
+        _("Max candidates kept in candidate window when scrolling"), 500,
+        // Eviction keeps 2 chunks of up to MaxColumnCount * (MaxRowCount + 1)
+        // candidates each.
+        IntConstrain(220, 5000)};
     Option<KeyList> expand{
         this, "Expand", _("Expand"), {Key(FcitxKey_equal), Key(FcitxKey_Down)}};
     Option<KeyList> collapse{
@@ -373,6 +400,10 @@ FCITX_CONFIGURATION(
     OptionWithAnnotation<std::string, CssAnnotation> userCss{
         this, "UserCss", _("User CSS"), {}};
     Option<KeyList> copyHtml{this, "CopyHtml", _("Copy HTML"), {}};
+    Option<int, IntConstrain> hideDelay{
+        this, "HideDelay",
+        _("Delay of hiding candidate window after commit in milliseconds"),
+        50, IntConstrain(0, 1000)};
     ExternalOption pluginDir{this, "PluginDir", _("Plugin dir"), ""};
     Option<bool> pluginNotice{this, "PluginNotice",
                               _("I know there may be risks for using plugins"),
@@ -421,17 +452,114 @@ public:
     void updateInputPanel(const Text &preedit, const Text &auxUp,
                           const Text &auxDown);
     void applyAppAccentColor(const std::string &accentColor);
+    nlohmann::json metrics() const;
+    // Latency from process_key receiving a key to candidate window showing
+    // its frame. Both are called in fcitx thread, around processing the key.
+    void keyReceived(std::chrono::steady_clock::time_point time);
+    void keyProcessed();
+    // Same as Instance::outputFilter, but memoized.
+    Text outputFilter(InputContext *ic, const Text &text);
+    // Texts are never password preedit.
+    std::vector<Text> outputFilter(InputContext *ic,
+                                   const std::vector<Text> &texts);
+    // Filter state may have changed without an event WebPanel watches.
+    void invalidateFilterState() { filterStateIC_.unwatch(); }
+    void clearFilterCache() {
+        filterCache_.clear();
+        invalidateFilterState();
+    }
+    // Replace WebviewCandidateWindow for WebPanels created after this.
+    static void setWindowFactory(PanelWindowFactory factory);
 
 private:
     Instance *instance_;
-    std::unique_ptr<candidate_window::WebviewCandidateWindow> window_;
+    std::unique_ptr<PanelWindow> window_;
 
     static const inline std::string ConfPath = "conf/webpanel.conf";
     WebPanelConfig config_;
+    // What was sent to candidate window, null if nothing.
+    nlohmann::json appliedConfig_;
+    std::string sentStyle_;
+    StyleCache styleCache_{
+        StandardPaths::global().userDirectory(StandardPathsType::PkgConfig) /
+            ConfPath,
+        StandardPaths::global().userDirectory(StandardPathsType::PkgData) /
+            "theme/style-cache.json"};
     std::unique_ptr<HandlerTableEntry<EventHandler>> eventHandler_;
+    std::vector<std::unique_ptr<HandlerTableEntry<EventHandler>>>
+        filterEventHandlers_;
+    FilterCache filterCache_{2048};
+    // Output filter state of filterStateIC_, interned by filterCache_.
+    FilterCache::State filterState_ = 0;
+    TrackableObjectReference<InputContext> filterStateIC_;
+    void updateFilterState(InputContext *ic);
+    PanelKeyTable keyTable_;
+    void updateKeyTable();
 
     void updateClient(InputContext *ic);
+    // Input panel updates are coalesced into one render per event loop
+    // iteration.
+    std::unique_ptr<EventSource> renderEvent_;
+    // The render callback is running, and sends command_ when it's done.
+    bool rendering_ = false;
+    TrackableObjectReference<InputContext> renderIC_;
+    void scheduleRender(InputContext *inputContext);
+    void render(InputContext *inputContext);
+    struct {
+        uint64_t renders = 0;
+        // Updates superseded by a later one before rendering.
+        uint64_t skippedRenders = 0;
+        // Hides postponed by HideDelay, and those cancelled by content
+        // coming back, each saving an order out and in of window.
+        uint64_t delayedHides = 0;
+        uint64_t avoidedHides = 0;
+        // Callbacks of candidate window dropped as candidates were replaced.
+        uint64_t staleCallbacks = 0;
+        // Highlights by hovering, and those reaching engine after throttling.
+        std::atomic<uint64_t> generatedHighlights = 0;
+        uint64_t deliveredHighlights = 0;
+        // update_input_panel, set_layout, set_writing_mode and
+        // set_paging_buttons skipped as nothing changed.
+        uint64_t skippedWindowCalls = 0;
+    } metrics_;
+    // Main thread side effects of the frame being built, sent at the end of
+    // render or event loop iteration.
+    PanelCommand command_;
+    std::unique_ptr<EventSource> commandEvent_;
+    PanelMailbox mailbox_;
+    PanelCommand &command();
+    void sendCommand();
+    void sendCandidates(std::shared_ptr<const CandidateFrame> frame);
+    // A key being processed, numbered by frameSeq_. Engine time ends when
+    // its frame starts rendering, and UI time covers rendering, waiting for
+    // main thread and showing.
+    struct KeyFrame {
+        using Clock = std::chrono::steady_clock;
+        uint64_t seq;
+        Clock::time_point received;
+        Clock::time_point rendered;
+    };
+    uint64_t frameSeq_ = 0;
+    std::optional<KeyFrame> keyFrame_;
+    struct {
+        mutable std::mutex mutex;
+        LatencyHistogram total;
+        LatencyHistogram engine;
+        LatencyHistogram ui;
+        uint64_t shownSeq = 0;
+    } keyLatency_;
+    void recordKeyFrame(const KeyFrame &frame);
+    nlohmann::json keyLatencyJson() const;
     void showAsync(bool show);
+    // Hiding right after commit is delayed so that e.g. committing a
+    // punctuation and typing on doesn't hide and show window. Other hides,
+    // e.g. by Esc, are immediate.
+    std::unique_ptr<EventSourceTime> hideEvent_;
+    std::unique_ptr<HandlerTableEntry<EventHandler>> commitEventHandler_;
+    bool delayHide_ = false;
+    bool shown_ = false;
+    bool hideDelayed() const;
+    void hideAsync();
     PanelShowFlags panelShow_;
     inline void updatePanelShowFlags(bool condition, PanelShowFlag flag) {
         if (condition)
@@ -440,9 +568,95 @@ private:
             panelShow_ = panelShow_.unset(flag);
     }
 
+    // Identifies what indices of candidate window refer to, renewed whenever
+    // candidates are replaced. windowCandidatesId_ is the one candidate
+    // window has received, and only written in main thread.
+    uint64_t candidatesId_ = 0;
+    std::atomic<uint64_t> windowCandidatesId_ = 0;
+    // Actions enumerated for the candidate window, by its index, for
+    // candidates of actionsId_.
+    std::unordered_map<int, std::vector<candidate_window::CandidateAction>>
+        actions_;
+    uint64_t actionsId_ = 0;
+    // Run callback of candidate window in fcitx thread without waiting. An
+    // indexed one, which refers to a candidate by index, is dropped if
+    // candidates have been replaced by then. Relative ones like paging are
+    // not indexed.
+    void post(std::function<void(InputContext *)> callback,
+              bool indexed = true);
+    // Latest hovered index and its candidates id, waiting for the next
+    // display frame. Only accessed in main thread.
+    std::optional<std::pair<int, uint64_t>> pendingHighlight_;
+    bool highlightThrottled_ = false;
+    void flushHighlight();
+    void highlight(InputContext *ic, int index);
     candidate_window::scroll_state_t scrollState_ =
         candidate_window::scroll_state_t::none;
+    // What the candidate window currently renders, if known.
+    std::shared_ptr<const CandidateFrame> lastFrame_;
+    // Identifies preedit and aux last sent with their filter state, empty if
+    // unknown.
+    std::string inputPanelKey_;
+    FilterCache::State inputPanelState_ = 0;
+    std::optional<std::tuple<bool, bool, bool>> sentPagingButtons_;
+    std::optional<candidate_window::layout_t> sentLayout_;
+    std::optional<candidate_window::writing_mode_t> sentWritingMode_;
+    bool inputPanelChanged(InputContext *ic);
+    void setLayout(bool pageable, bool hasPrev, bool hasNext,
+                   candidate_window::layout_t layout,
+                   candidate_window::writing_mode_t writingMode);
+    // Candidate window may have been reset, e.g. by style.
+    void forgetWindowState();
+    // Send frame if changed. actionsOf enumerates actions of the i-th
+    // candidate, and is only called for candidates that have actions in a
+    // changed frame.
+    void setCandidates(
+        CandidateFrame frame,
+        const std::function<std::vector<candidate_window::CandidateAction>(
+            size_t)> &actionsOf = {});
+    // Indices of candidate window are relative to scrollOffset_ in scroll
+    // mode.
+    int toGlobalIndex(int index) const;
     void scroll(int start, int count);
+    bool renderScroll(InputContext *ic, int start, int count);
+    void scrollBack(InputContext *ic, int index);
+    bool fetchCandidates(InputContext *ic,
+                         const std::shared_ptr<CandidateList> &list, int start,
+                         int count,
+                         std::vector<candidate_window::Candidate> &candidates);
+    int fetchRange(const std::shared_ptr<CandidateList> &list, int start,
+                   int count, std::vector<const CandidateWord *> &words);
+    // totalSize of a bulk list, or its known end, or -1 if unknown.
+    int bulkEnd(const std::shared_ptr<CandidateList> &list) const;
+    const CandidateWord *
+    candidateFromAll(const std::shared_ptr<CandidateList> &list, int index);
+    const CandidateWord *candidateAt(const std::shared_ptr<CandidateList> &list,
+                                     int index);
+    // A bulk list of unknown size and where candidateFromAll threw for it.
+    std::weak_ptr<CandidateList> knownEndList_;
+    int knownEnd_ = -1;
+    // Scroll mode fetches candidates in chunks when candidate window asks for
+    // them. The next chunk is fetched ahead during idle time once highlight
+    // is within PrefetchDistance of the loaded end.
+    struct PrefetchedChunk {
+        int start;
+        std::vector<candidate_window::Candidate> candidates;
+        bool endReached;
+    };
+    std::weak_ptr<CandidateList> scrollList_;
+    // Candidate window holds [scrollOffset_, scrollLoadedEnd_) of the list,
+    // at most ResidentCandidates. Rows far behind are evicted when more are
+    // loaded, and fetched again when user moves back to them.
+    int scrollOffset_ = 0;
+    int scrollLoadedEnd_ = 0;
+    int scrollChunkSize_ = 0;
+    bool scrollEndReached_ = false;
+    std::optional<PrefetchedChunk> prefetched_;
+    std::unique_ptr<EventSource> prefetchEvent_;
+    void maybePrefetch(int index);
+    void prefetch();
+    void resetPrefetch();
+    int expandCount() const;
     void expand();
     void collapse();
 };